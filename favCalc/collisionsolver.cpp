@@ -0,0 +1,186 @@
+// collisionsolver.cpp
+
+#include "collisionsolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Fraction of each overlap resolved per step.
+static const float kStiffness = 0.5f;
+// Nodes closer than this (squared) are pushed apart along x, by index.
+static const float kCoincident2 = 1e-6f;
+// Nodes per unit of work handed out to threads.
+static const int kChunkSize = 512;
+// Fewer nodes than this are not worth waking other threads for.
+static const int kParallelThreshold = 4096;
+
+// Takes the first chunk of a worker's range; its owner does this.
+static int takeFirst(std::atomic<quint64> &range) {
+    quint64 value = range.load();
+    for (;;) {
+        const quint32 first = quint32(value >> 32);
+        const quint32 end = quint32(value);
+        if (first >= end)
+            return -1;
+        if (range.compare_exchange_weak(value, quint64(first + 1) << 32 | end))
+            return int(first);
+    }
+}
+
+// Takes the last chunk of a worker's range; other workers steal this way.
+static int takeLast(std::atomic<quint64> &range) {
+    quint64 value = range.load();
+    for (;;) {
+        const quint32 first = quint32(value >> 32);
+        const quint32 end = quint32(value);
+        if (first >= end)
+            return -1;
+        if (range.compare_exchange_weak(value, quint64(first) << 32 | (end - 1)))
+            return int(end - 1);
+    }
+}
+
+CollisionSolver::CollisionSolver(qreal radius)
+    : m_radius(float(radius)), m_cellSize(float(qMax<qreal>(0.5, 2 * radius))) {
+}
+
+int CollisionSolver::threadCount() const {
+    return m_threadCount > 0 ? m_threadCount : qMax(1, QThread::idealThreadCount());
+}
+
+int CollisionSolver::bucketOf(int cellX, int cellY) const {
+    return int((quint32(cellX) * 73856093u ^ quint32(cellY) * 19349663u) & m_bucketMask);
+}
+
+// Counting sort of the nodes by bucket. Nodes keep their relative order
+// within a bucket, so the sums in the narrow phase always run the same way.
+void CollisionSolver::buildGrid(const float *x, const float *y, int count) {
+    float minX = x[0];
+    float minY = y[0];
+    for (int i = 1; i < count; ++i) {
+        minX = std::min(minX, x[i]);
+        minY = std::min(minY, y[i]);
+    }
+    m_originX = minX;
+    m_originY = minY;
+
+    // About two buckets per node, so few cells share one.
+    quint32 buckets = 16;
+    while (buckets < quint32(count) * 2)
+        buckets *= 2;
+    m_bucketMask = buckets - 1;
+
+    m_bucketStart.fill(0, buckets + 1);
+    m_cellX.resize(count);
+    m_cellY.resize(count);
+    for (int i = 0; i < count; ++i) {
+        m_cellX[i] = int((x[i] - m_originX) / m_cellSize);
+        m_cellY[i] = int((y[i] - m_originY) / m_cellSize);
+        ++m_bucketStart[bucketOf(m_cellX.at(i), m_cellY.at(i)) + 1];
+    }
+    for (quint32 b = 0; b < buckets; ++b)
+        m_bucketStart[b + 1] += m_bucketStart.at(b);
+
+    m_cursor = m_bucketStart;
+    m_order.resize(count);
+    for (int i = 0; i < count; ++i)
+        m_order[m_cursor[bucketOf(m_cellX.at(i), m_cellY.at(i))]++] = i;
+
+    // Neighbours are read in bucket order; keep their positions that way.
+    m_sortedX.resize(count);
+    m_sortedY.resize(count);
+    for (int k = 0; k < count; ++k) {
+        m_sortedX[k] = x[m_order.at(k)];
+        m_sortedY[k] = y[m_order.at(k)];
+    }
+}
+
+void CollisionSolver::solveChunk(int chunk) {
+    const float diameter = 2 * m_radius;
+    const float diameter2 = diameter * diameter;
+    const float share = 0.5f * kStiffness;
+    const int end = qMin(m_count, (chunk + 1) * kChunkSize);
+
+    for (int k = chunk * kChunkSize; k < end; ++k) {
+        const int i = m_order.at(k);
+        const float xi = m_sortedX.at(k);
+        const float yi = m_sortedY.at(k);
+        float pushX = 0;
+        float pushY = 0;
+
+        // Different cells can hash to the same bucket; each bucket is
+        // searched once.
+        int visited[9];
+        int visitedCount = 0;
+        for (int cellY = m_cellY.at(i) - 1; cellY <= m_cellY.at(i) + 1; ++cellY) {
+            for (int cellX = m_cellX.at(i) - 1; cellX <= m_cellX.at(i) + 1; ++cellX) {
+                const int bucket = bucketOf(cellX, cellY);
+                if (std::find(visited, visited + visitedCount, bucket) != visited + visitedCount)
+                    continue;
+                visited[visitedCount++] = bucket;
+
+                for (int t = m_bucketStart.at(bucket); t < m_bucketStart.at(bucket + 1); ++t) {
+                    const float dx = xi - m_sortedX.at(t);
+                    const float dy = yi - m_sortedY.at(t);
+                    const float dist2 = dx * dx + dy * dy;
+                    if (dist2 >= diameter2 || t == k)
+                        continue;
+                    if (dist2 > kCoincident2) {
+                        const float dist = std::sqrt(dist2);
+                        const float push = (diameter - dist) / dist * share;
+                        pushX += dx * push;
+                        pushY += dy * push;
+                    } else {
+                        pushX += (i < m_order.at(t) ? -diameter : diameter) * share;
+                    }
+                }
+            }
+        }
+        m_dx[i] = pushX;
+        m_dy[i] = pushY;
+    }
+}
+
+void CollisionSolver::runWorker(int worker) {
+    for (;;) {
+        int chunk = takeFirst(m_work[worker].chunks);
+        for (int i = 1; chunk < 0 && i < m_workerCount; ++i)
+            chunk = takeLast(m_work[(worker + i) % m_workerCount].chunks);
+        if (chunk < 0)
+            return;
+        solveChunk(chunk);
+    }
+}
+
+void CollisionSolver::solve(const float *x, const float *y, int count) {
+    m_count = count;
+    m_dx.resize(count);
+    m_dy.resize(count);
+    if (count == 0)
+        return;
+    buildGrid(x, y, count);
+
+    const int chunks = (count + kChunkSize - 1) / kChunkSize;
+    m_workerCount = count < kParallelThreshold ? 1 : qMin(threadCount(), chunks);
+    if (m_workerCount > m_workCapacity) {
+        m_work.reset(new WorkRange[m_workerCount]);
+        m_workCapacity = m_workerCount;
+    }
+    // Each worker starts with a contiguous share of the chunks.
+    for (int w = 0; w < m_workerCount; ++w) {
+        const quint64 first = quint64(chunks) * w / m_workerCount;
+        const quint64 end = quint64(chunks) * (w + 1) / m_workerCount;
+        m_work[w].chunks.store(first << 32 | end);
+    }
+
+    // The calling thread is worker 0 rather than idling.
+    QSemaphore done;
+    for (int w = 1; w < m_workerCount; ++w) {
+        QThreadPool::globalInstance()->start([this, w, &done] {
+            runWorker(w);
+            done.release();
+        });
+    }
+    runWorker(0);
+    done.acquire(m_workerCount - 1);
+}
@@ -0,0 +1,68 @@
+// collisionsolver.h
+
+#ifndef COLLISIONSOLVER_H
+#define COLLISIONSOLVER_H
+
+#include <QtCore>
+#include <atomic>
+#include <memory>
+
+// Pushes apart circles of equal radius that overlap. Each call sorts the
+// nodes into a hashed grid of cells one diameter wide (the broad phase),
+// then for every node sums how far each overlapping neighbour pushes it
+// (the narrow phase). Pairs push both nodes by half their overlap times a
+// stiffness factor, so they separate over a few steps without jitter.
+//
+// The narrow phase is split into chunks of nodes that threads take from
+// their own share of the work and steal from each other's when done. Each
+// node's push is summed by one thread in a fixed order and written to its
+// own slot, so the results do not depend on the thread count or timing.
+class CollisionSolver {
+public:
+    explicit CollisionSolver(qreal radius);
+
+    qreal radius() const { return m_radius; }
+
+    // 0 means QThread::idealThreadCount().
+    void setThreadCount(int count) { m_threadCount = count; }
+    int threadCount() const;
+
+    // Computes the push of the 'count' nodes at (x[i], y[i]), read back
+    // with dx() and dy() in the same order.
+    void solve(const float *x, const float *y, int count);
+
+    const float *dx() const { return m_dx.constData(); }
+    const float *dy() const { return m_dy.constData(); }
+
+private:
+    void buildGrid(const float *x, const float *y, int count);
+    void solveChunk(int chunk);
+    void runWorker(int worker);
+    int bucketOf(int cellX, int cellY) const;
+
+    struct alignas(64) WorkRange {
+        std::atomic<quint64> chunks; // first << 32 | end
+    };
+
+    float m_radius;
+    int m_threadCount = 0;
+    int m_count = 0;
+    float m_cellSize;
+    float m_originX = 0;
+    float m_originY = 0;
+    quint32 m_bucketMask = 0;
+    QList<int> m_bucketStart; // m_order index of each bucket's first node
+    QList<int> m_order;       // nodes sorted by bucket
+    QList<int> m_cursor;
+    QList<int> m_cellX;
+    QList<int> m_cellY;
+    QList<float> m_sortedX;
+    QList<float> m_sortedY;
+    QList<float> m_dx;
+    QList<float> m_dy;
+    std::unique_ptr<WorkRange[]> m_work;
+    int m_workCapacity = 0;
+    int m_workerCount = 0;
+};
+
+#endif // COLLISIONSOLVER_H
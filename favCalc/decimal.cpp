@@ -0,0 +1,718 @@
+// decimal.cpp
+
+#include "decimal.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+const quint32 kBillion = 1000000000;
+const quint32 kSmallPowersOfTen[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+// Larger exponents in text make it invalid rather than a coefficient with
+// that many digits.
+const int kMaxExponent = 1000;
+
+#ifdef DECIMAL_INT128
+__extension__ typedef __int128 Int128;
+__extension__ typedef unsigned __int128 UInt128;
+
+// Decimal digits that always fit in a UInt128, and their powers of ten.
+const int kWideDigits = 38;
+
+struct PowersOfTen {
+    constexpr PowersOfTen() : values() {
+        values[0] = 1;
+        for (int i = 1; i <= kWideDigits; ++i)
+            values[i] = values[i - 1] * 10;
+    }
+    UInt128 values[kWideDigits + 1];
+};
+constexpr PowersOfTen kPowersOfTen;
+
+// Multiplies by 10^digits, or returns false if that overflows.
+template <typename T>
+bool scaleUp(T &value, int digits) {
+    return digits == 0 || (digits <= kWideDigits && !__builtin_mul_overflow(value, T(kPowersOfTen.values[digits]), &value));
+}
+
+UInt128 magnitude(Int128 value) {
+    return value < 0 ? UInt128(0) - UInt128(value) : UInt128(value);
+}
+#endif
+
+// Blocks of limbs in power-of-two capacities from 4 to 4 << (kClassCount - 1),
+// one free list per capacity threaded through the freed blocks themselves.
+// Larger blocks come from the heap and go straight back.
+class LimbPool {
+public:
+    // Never destroyed: a Decimal with static storage may be released after
+    // the pool's destructor would have run.
+    static LimbPool &instance() {
+        static LimbPool *pool = new LimbPool;
+        return *pool;
+    }
+
+    quint32 *allocate(int count) {
+        const int sizeClass = classOf(count);
+        const quint32 capacity = sizeClass < kClassCount ? 4u << sizeClass : quint32(count);
+        Block *block = nullptr;
+        {
+            QMutexLocker locker(&m_mutex);
+            ++m_statistics.allocations;
+            if (sizeClass < kClassCount && m_free[sizeClass]) {
+                block = m_free[sizeClass];
+                m_free[sizeClass] = block->next;
+            } else {
+                ++m_statistics.heapAllocations;
+            }
+        }
+        if (!block) {
+            block = static_cast<Block *>(std::malloc(sizeof(Block) + capacity * sizeof(quint32)));
+            Q_CHECK_PTR(block);
+        }
+        block->capacity = capacity;
+        return reinterpret_cast<quint32 *>(block + 1);
+    }
+
+    void release(quint32 *limbs) {
+        Block *block = reinterpret_cast<Block *>(limbs) - 1;
+        const int sizeClass = classOf(int(block->capacity));
+        if (sizeClass >= kClassCount) {
+            std::free(block);
+            return;
+        }
+        QMutexLocker locker(&m_mutex);
+        block->next = m_free[sizeClass];
+        m_free[sizeClass] = block;
+    }
+
+    Decimal::PoolStatistics statistics() {
+        QMutexLocker locker(&m_mutex);
+        return m_statistics;
+    }
+
+private:
+    static const int kClassCount = 16;
+
+    struct Block {
+        Block *next; // while free
+        quint32 capacity;
+    };
+
+    static int classOf(int count) {
+        return count <= 4 ? 0 : 30 - qCountLeadingZeroBits(quint32(count - 1));
+    }
+
+    QMutex m_mutex;
+    Block *m_free[kClassCount] = {};
+    Decimal::PoolStatistics m_statistics;
+};
+
+// A read-only run of limbs, least significant first, without leading zeros.
+struct Limbs {
+    const quint32 *data;
+    int size;
+};
+
+// A magnitude being computed, in a block from the pool.
+struct Magnitude {
+    explicit Magnitude(int capacity) : limbs(LimbPool::instance().allocate(qMax(1, capacity))) {}
+    Magnitude(Magnitude &&other) noexcept : limbs(std::exchange(other.limbs, nullptr)), size(other.size) {}
+    Magnitude(const Magnitude &) = delete;
+    Magnitude &operator=(const Magnitude &) = delete;
+    ~Magnitude() {
+        if (limbs)
+            LimbPool::instance().release(limbs);
+    }
+
+    Limbs view() const { return { limbs, size }; }
+
+    void trim() {
+        while (size > 0 && limbs[size - 1] == 0)
+            --size;
+    }
+
+    // this * factor + addend; the capacity must allow for one more limb.
+    void multiplyAdd(quint32 factor, quint32 addend) {
+        quint64 carry = addend;
+        for (int i = 0; i < size; ++i) {
+            carry += quint64(limbs[i]) * factor;
+            limbs[i] = quint32(carry);
+            carry >>= 32;
+        }
+        if (carry)
+            limbs[size++] = quint32(carry);
+    }
+
+    // Divides in place and returns the remainder.
+    quint32 divide(quint32 divisor) {
+        quint64 remainder = 0;
+        for (int i = size - 1; i >= 0; --i) {
+            remainder = remainder << 32 | limbs[i];
+            limbs[i] = quint32(remainder / divisor);
+            remainder %= divisor;
+        }
+        trim();
+        return quint32(remainder);
+    }
+
+    quint32 *limbs;
+    int size = 0;
+};
+
+int compare(Limbs a, Limbs b) {
+    if (a.size != b.size)
+        return a.size < b.size ? -1 : 1;
+    for (int i = a.size - 1; i >= 0; --i) {
+        if (a.data[i] != b.data[i])
+            return a.data[i] < b.data[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+Magnitude add(Limbs a, Limbs b) {
+    if (a.size < b.size)
+        std::swap(a, b);
+    Magnitude sum(a.size + 1);
+    quint64 carry = 0;
+    for (int i = 0; i < a.size; ++i) {
+        carry += quint64(a.data[i]) + (i < b.size ? b.data[i] : 0);
+        sum.limbs[i] = quint32(carry);
+        carry >>= 32;
+    }
+    sum.limbs[a.size] = quint32(carry);
+    sum.size = a.size + 1;
+    sum.trim();
+    return sum;
+}
+
+// a - b, where a >= b.
+Magnitude subtract(Limbs a, Limbs b) {
+    Magnitude difference(a.size);
+    quint64 borrow = 0;
+    for (int i = 0; i < a.size; ++i) {
+        const quint64 limb = quint64(a.data[i]) - (i < b.size ? b.data[i] : 0) - borrow;
+        difference.limbs[i] = quint32(limb);
+        borrow = limb >> 63;
+    }
+    difference.size = a.size;
+    difference.trim();
+    return difference;
+}
+
+Magnitude multiply(Limbs a, Limbs b) {
+    Magnitude product(a.size + b.size);
+    product.size = a.size + b.size;
+    std::fill(product.limbs, product.limbs + product.size, 0);
+    for (int i = 0; i < a.size; ++i) {
+        quint64 carry = 0;
+        for (int j = 0; j < b.size; ++j) {
+            carry += quint64(a.data[i]) * b.data[j] + product.limbs[i + j];
+            product.limbs[i + j] = quint32(carry);
+            carry >>= 32;
+        }
+        product.limbs[i + b.size] = quint32(carry);
+    }
+    product.trim();
+    return product;
+}
+
+// a * 10^digits
+Magnitude scaled(Limbs a, int digits) {
+    Magnitude result(a.size + digits / 9 + 2);
+    std::copy(a.data, a.data + a.size, result.limbs);
+    result.size = a.size;
+    for (; digits >= 9; digits -= 9)
+        result.multiplyAdd(kBillion, 0);
+    if (digits > 0)
+        result.multiplyAdd(kSmallPowersOfTen[digits], 0);
+    return result;
+}
+
+// Long division as in Knuth's algorithm D, with the divisor shifted so its
+// top limb has its top bit set; d must not be zero.
+std::pair<Magnitude, Magnitude> divide(Limbs n, Limbs d) {
+    if (n.size < d.size) {
+        Magnitude remainder(n.size);
+        std::copy(n.data, n.data + n.size, remainder.limbs);
+        remainder.size = n.size;
+        return { Magnitude(1), std::move(remainder) };
+    }
+
+    Magnitude quotient(n.size - d.size + 1);
+    quotient.size = n.size - d.size + 1;
+    if (d.size == 1) {
+        std::copy(n.data, n.data + n.size, quotient.limbs);
+        quotient.size = n.size;
+        Magnitude remainder(1);
+        remainder.limbs[0] = quotient.divide(d.data[0]);
+        remainder.size = 1;
+        remainder.trim();
+        return { std::move(quotient), std::move(remainder) };
+    }
+
+    const quint64 base = quint64(1) << 32;
+    const int shift = qCountLeadingZeroBits(d.data[d.size - 1]);
+    Magnitude v(d.size);
+    for (int i = d.size - 1; i > 0; --i)
+        v.limbs[i] = d.data[i] << shift | quint32(quint64(d.data[i - 1]) >> (32 - shift));
+    v.limbs[0] = d.data[0] << shift;
+    Magnitude u(n.size + 1);
+    u.limbs[n.size] = quint32(quint64(n.data[n.size - 1]) >> (32 - shift));
+    for (int i = n.size - 1; i > 0; --i)
+        u.limbs[i] = n.data[i] << shift | quint32(quint64(n.data[i - 1]) >> (32 - shift));
+    u.limbs[0] = n.data[0] << shift;
+
+    const int m = d.size;
+    for (int j = n.size - m; j >= 0; --j) {
+        const quint64 top = quint64(u.limbs[j + m]) << 32 | u.limbs[j + m - 1];
+        quint64 estimate = top / v.limbs[m - 1];
+        quint64 rest = top % v.limbs[m - 1];
+        while (estimate >= base || estimate * v.limbs[m - 2] > (rest << 32 | u.limbs[j + m - 2])) {
+            --estimate;
+            rest += v.limbs[m - 1];
+            if (rest >= base)
+                break;
+        }
+
+        qint64 borrow = 0;
+        qint64 t;
+        for (int i = 0; i < m; ++i) {
+            const quint64 product = estimate * v.limbs[i];
+            t = qint64(u.limbs[i + j]) - borrow - qint64(product & 0xffffffff);
+            u.limbs[i + j] = quint32(t);
+            borrow = qint64(product >> 32) - (t >> 32);
+        }
+        t = qint64(u.limbs[j + m]) - borrow;
+        u.limbs[j + m] = quint32(t);
+
+        quotient.limbs[j] = quint32(estimate);
+        if (t < 0) {
+            // The estimate was one too large: add the divisor back.
+            --quotient.limbs[j];
+            quint64 carry = 0;
+            for (int i = 0; i < m; ++i) {
+                carry += quint64(u.limbs[i + j]) + v.limbs[i];
+                u.limbs[i + j] = quint32(carry);
+                carry >>= 32;
+            }
+            u.limbs[j + m] += quint32(carry);
+        }
+    }
+    quotient.trim();
+
+    Magnitude remainder(m);
+    for (int i = 0; i < m - 1; ++i)
+        remainder.limbs[i] = u.limbs[i] >> shift | quint32(quint64(u.limbs[i + 1]) << (32 - shift));
+    remainder.limbs[m - 1] = u.limbs[m - 1] >> shift;
+    remainder.size = m;
+    remainder.trim();
+    return { std::move(quotient), std::move(remainder) };
+}
+
+// n / d rounded half away from zero.
+Magnitude divideRounded(Limbs n, Limbs d) {
+    std::pair<Magnitude, Magnitude> result = divide(n, d);
+    const Magnitude twice = add(result.second.view(), result.second.view());
+    if (compare(twice.view(), d) < 0)
+        return std::move(result.first);
+    const quint32 one = 1;
+    return add(result.first.view(), { &one, 1 });
+}
+
+} // namespace
+
+// The parts of the arithmetic that need the representation.
+class DecimalArithmetic {
+public:
+    static bool isNegative(const Decimal &d) {
+#ifdef DECIMAL_INT128
+        if (d.m_kind == Decimal::Small)
+            return d.m_small < 0;
+#endif
+        return d.m_negative;
+    }
+
+    static bool isZero(const Decimal &d) {
+#ifdef DECIMAL_INT128
+        if (d.m_kind == Decimal::Small)
+            return d.m_small == 0;
+#endif
+        return d.m_size == 0;
+    }
+
+    // The magnitude of the coefficient, using 'local' if it is inline.
+    static Limbs limbs(const Decimal &d, quint32 (&local)[4]) {
+#ifdef DECIMAL_INT128
+        if (d.m_kind == Decimal::Small) {
+            UInt128 value = magnitude(d.m_small);
+            int size = 0;
+            for (; value; value >>= 32)
+                local[size++] = quint32(value);
+            return { local, size };
+        }
+#else
+        Q_UNUSED(local);
+#endif
+        return { d.m_limbs, d.m_size };
+    }
+
+    // Takes the magnitude's block, or releases it if the value fits inline.
+    static Decimal fromMagnitude(Magnitude &&magnitude, bool negative, int scale) {
+        magnitude.trim();
+#ifdef DECIMAL_INT128
+        if (magnitude.size <= 4) {
+            UInt128 value = 0;
+            for (int i = magnitude.size - 1; i >= 0; --i)
+                value = value << 32 | magnitude.limbs[i];
+            if (fitsInline(value, negative))
+                return fromWide(value, negative, scale);
+        }
+#endif
+        Decimal d;
+        d.m_kind = Decimal::Big;
+        d.m_scale = scale;
+        d.m_negative = negative && magnitude.size > 0;
+        d.m_size = magnitude.size;
+        if (magnitude.size > 0)
+            d.m_limbs = std::exchange(magnitude.limbs, nullptr);
+        return d;
+    }
+
+#ifdef DECIMAL_INT128
+    static bool fitsInline(UInt128 value, bool negative) {
+        const UInt128 limit = UInt128(1) << 127;
+        return negative ? value <= limit : value < limit;
+    }
+
+    static Decimal fromSmall(Int128 value, int scale) {
+        Decimal d;
+        d.m_small = value;
+        d.m_scale = scale;
+        return d;
+    }
+
+    static Decimal fromWide(UInt128 value, bool negative, int scale) {
+        if (!fitsInline(value, negative)) {
+            Magnitude magnitude(4);
+            for (; value; value >>= 32)
+                magnitude.limbs[magnitude.size++] = quint32(value);
+            return fromMagnitude(std::move(magnitude), negative, scale);
+        }
+        return fromSmall(negative ? Int128(UInt128(0) - value) : Int128(value), scale);
+    }
+#endif
+
+    static Decimal add(const Decimal &a, const Decimal &b, bool negateB) {
+        quint32 localA[4], localB[4];
+        const int scale = qMax(a.m_scale, b.m_scale);
+        const Magnitude x = scaled(limbs(a, localA), scale - a.m_scale);
+        const Magnitude y = scaled(limbs(b, localB), scale - b.m_scale);
+        const bool xNegative = isNegative(a);
+        const bool yNegative = isNegative(b) != negateB;
+        if (xNegative == yNegative)
+            return fromMagnitude(::add(x.view(), y.view()), xNegative, scale);
+        if (compare(x.view(), y.view()) >= 0)
+            return fromMagnitude(subtract(x.view(), y.view()), xNegative, scale);
+        return fromMagnitude(subtract(y.view(), x.view()), yNegative, scale);
+    }
+
+    static Decimal multiply(const Decimal &a, const Decimal &b) {
+        quint32 localA[4], localB[4];
+        return fromMagnitude(::multiply(limbs(a, localA), limbs(b, localB)),
+                             isNegative(a) != isNegative(b), a.m_scale + b.m_scale);
+    }
+
+    // a / b to kDivisionScale places is a * 10^(kDivisionScale + b's scale -
+    // a's scale) / b, with the power of ten on whichever side keeps it whole.
+    static Decimal divide(const Decimal &a, const Decimal &b) {
+        quint32 localA[4], localB[4];
+        const int exponent = Decimal::kDivisionScale + b.m_scale - a.m_scale;
+        const Magnitude n = scaled(limbs(a, localA), qMax(0, exponent));
+        const Magnitude d = scaled(limbs(b, localB), qMax(0, -exponent));
+        return fromMagnitude(divideRounded(n.view(), d.view()), isNegative(a) != isNegative(b),
+                             Decimal::kDivisionScale);
+    }
+
+    // The coefficient's magnitude in decimal, most significant digit first.
+    static QByteArray digits(const Decimal &d) {
+        QByteArray text;
+#ifdef DECIMAL_INT128
+        if (d.m_kind == Decimal::Small) {
+            char buffer[kWideDigits + 2];
+            char *end = buffer + sizeof(buffer);
+            char *begin = end;
+            UInt128 value = magnitude(d.m_small);
+            do {
+                *--begin = char('0' + int(value % 10));
+                value /= 10;
+            } while (value);
+            return QByteArray(begin, end - begin);
+        }
+#endif
+        quint32 local[4];
+        const Limbs coefficient = limbs(d, local);
+        Magnitude rest = scaled(coefficient, 0);
+        while (rest.size > 0) {
+            const QByteArray chunk = QByteArray::number(rest.divide(kBillion));
+            text.prepend(chunk);
+            if (rest.size > 0)
+                text.prepend(QByteArray(9 - chunk.size(), '0'));
+        }
+        return text.isEmpty() ? QByteArray("0") : text;
+    }
+};
+
+Decimal::Decimal(const Decimal &other)
+    : m_kind(other.m_kind), m_negative(other.m_negative), m_scale(other.m_scale), m_size(other.m_size) {
+#ifdef DECIMAL_INT128
+    m_small = other.m_small;
+#endif
+    if (other.m_limbs) {
+        m_limbs = LimbPool::instance().allocate(m_size);
+        std::memcpy(m_limbs, other.m_limbs, m_size * sizeof(quint32));
+    }
+}
+
+Decimal::Decimal(Decimal &&other) noexcept
+    : m_kind(other.m_kind), m_negative(other.m_negative), m_scale(other.m_scale), m_size(other.m_size),
+      m_limbs(std::exchange(other.m_limbs, nullptr)) {
+#ifdef DECIMAL_INT128
+    m_small = other.m_small;
+#endif
+}
+
+Decimal::~Decimal() {
+    if (m_limbs)
+        LimbPool::instance().release(m_limbs);
+}
+
+Decimal &Decimal::operator=(const Decimal &other) {
+    if (this != &other) {
+        Decimal copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+Decimal &Decimal::operator=(Decimal &&other) noexcept {
+    swap(other);
+    return *this;
+}
+
+void Decimal::swap(Decimal &other) noexcept {
+#ifdef DECIMAL_INT128
+    std::swap(m_small, other.m_small);
+#endif
+    std::swap(m_kind, other.m_kind);
+    std::swap(m_negative, other.m_negative);
+    std::swap(m_scale, other.m_scale);
+    std::swap(m_size, other.m_size);
+    std::swap(m_limbs, other.m_limbs);
+}
+
+Decimal Decimal::invalid() {
+    Decimal d;
+    d.m_kind = Invalid;
+    return d;
+}
+
+Decimal Decimal::fromString(QStringView text) {
+    int pos = 0;
+    const bool negative = pos < text.size() && text.at(pos) == '-';
+    if (pos < text.size() && (text.at(pos) == '-' || text.at(pos) == '+'))
+        ++pos;
+
+    // Significant digits only: leading zeros are skipped, the point only
+    // counts towards the scale.
+    QVarLengthArray<char, 64> digits;
+    int scale = 0;
+    bool seenDigit = false;
+    bool seenPoint = false;
+    for (; pos < text.size(); ++pos) {
+        const char16_t c = text.at(pos).unicode();
+        if (c >= '0' && c <= '9') {
+            seenDigit = true;
+            if (seenPoint)
+                ++scale;
+            if (!digits.isEmpty() || c != '0')
+                digits.append(char(c));
+        } else if (c == '.' && !seenPoint) {
+            seenPoint = true;
+        } else {
+            break;
+        }
+    }
+    if (!seenDigit)
+        return invalid();
+
+    if (pos < text.size() && (text.at(pos) == 'e' || text.at(pos) == 'E')) {
+        ++pos;
+        const bool negativeExponent = pos < text.size() && text.at(pos) == '-';
+        if (pos < text.size() && (text.at(pos) == '-' || text.at(pos) == '+'))
+            ++pos;
+        const int start = pos;
+        int exponent = 0;
+        for (; pos < text.size() && text.at(pos).unicode() >= '0' && text.at(pos).unicode() <= '9'; ++pos) {
+            exponent = exponent * 10 + (text.at(pos).unicode() - '0');
+            if (exponent > kMaxExponent)
+                return invalid();
+        }
+        if (pos == start)
+            return invalid();
+        scale += negativeExponent ? exponent : -exponent;
+    }
+    if (pos != text.size())
+        return invalid();
+
+#ifdef DECIMAL_INT128
+    if (digits.size() <= kWideDigits && scale >= 0) {
+        UInt128 value = 0;
+        for (char digit : digits)
+            value = value * 10 + UInt128(digit - '0');
+        return DecimalArithmetic::fromWide(value, negative, scale);
+    }
+#endif
+    Magnitude coefficient(digits.size() / 9 + 2);
+    for (int first = 0; first < digits.size(); first += 9) {
+        const int count = qMin(9, int(digits.size()) - first);
+        quint32 chunk = 0;
+        for (int i = first; i < first + count; ++i)
+            chunk = chunk * 10 + quint32(digits[i] - '0');
+        coefficient.multiplyAdd(count == 9 ? kBillion : kSmallPowersOfTen[count], chunk);
+    }
+    if (scale < 0) {
+        Magnitude whole = scaled(coefficient.view(), -scale);
+        return DecimalArithmetic::fromMagnitude(std::move(whole), negative, 0);
+    }
+    return DecimalArithmetic::fromMagnitude(std::move(coefficient), negative, scale);
+}
+
+QString Decimal::toString() const {
+    if (!isValid())
+        return QString();
+
+    QByteArray text = DecimalArithmetic::digits(*this);
+    if (m_scale > 0) {
+        if (text.size() <= m_scale)
+            text.prepend(QByteArray(m_scale - text.size() + 1, '0'));
+        text.insert(text.size() - m_scale, '.');
+        while (text.endsWith('0'))
+            text.chop(1);
+        if (text.endsWith('.'))
+            text.chop(1);
+    }
+    if (DecimalArithmetic::isNegative(*this))
+        text.prepend('-');
+    return QString::fromLatin1(text);
+}
+
+Decimal Decimal::rounded(int scale) const {
+    scale = qMax(0, scale);
+    if (!isValid() || scale >= m_scale)
+        return *this;
+
+    const int digits = m_scale - scale;
+    const bool negative = DecimalArithmetic::isNegative(*this);
+#ifdef DECIMAL_INT128
+    if (m_kind == Small && digits <= kWideDigits) {
+        const UInt128 divisor = kPowersOfTen.values[digits];
+        const UInt128 value = magnitude(m_small);
+        UInt128 quotient = value / divisor;
+        const UInt128 remainder = value % divisor;
+        if (remainder >= divisor - remainder)
+            ++quotient;
+        return DecimalArithmetic::fromWide(quotient, negative, scale);
+    }
+#endif
+    quint32 local[4];
+    const quint32 one = 1;
+    const Magnitude divisor = scaled({ &one, 1 }, digits);
+    return DecimalArithmetic::fromMagnitude(divideRounded(DecimalArithmetic::limbs(*this, local), divisor.view()),
+                                            negative, scale);
+}
+
+Decimal Decimal::operator-() const {
+    if (!isValid())
+        return *this;
+#ifdef DECIMAL_INT128
+    if (m_kind == Small) {
+        Int128 negated;
+        if (!__builtin_sub_overflow(Int128(0), m_small, &negated))
+            return DecimalArithmetic::fromSmall(negated, m_scale);
+        return DecimalArithmetic::fromWide(magnitude(m_small), false, m_scale);
+    }
+#endif
+    Decimal negated(*this);
+    negated.m_negative = !m_negative && m_size > 0;
+    return negated;
+}
+
+Decimal operator+(const Decimal &a, const Decimal &b) {
+    if (!a.isValid() || !b.isValid())
+        return Decimal::invalid();
+#ifdef DECIMAL_INT128
+    if (a.m_kind == Decimal::Small && b.m_kind == Decimal::Small) {
+        const int scale = qMax(a.m_scale, b.m_scale);
+        Int128 x = a.m_small;
+        Int128 y = b.m_small;
+        if (scaleUp(x, scale - a.m_scale) && scaleUp(y, scale - b.m_scale) && !__builtin_add_overflow(x, y, &x))
+            return DecimalArithmetic::fromSmall(x, scale);
+    }
+#endif
+    return DecimalArithmetic::add(a, b, false);
+}
+
+Decimal operator-(const Decimal &a, const Decimal &b) {
+    if (!a.isValid() || !b.isValid())
+        return Decimal::invalid();
+#ifdef DECIMAL_INT128
+    if (a.m_kind == Decimal::Small && b.m_kind == Decimal::Small) {
+        const int scale = qMax(a.m_scale, b.m_scale);
+        Int128 x = a.m_small;
+        Int128 y = b.m_small;
+        if (scaleUp(x, scale - a.m_scale) && scaleUp(y, scale - b.m_scale) && !__builtin_sub_overflow(x, y, &x))
+            return DecimalArithmetic::fromSmall(x, scale);
+    }
+#endif
+    return DecimalArithmetic::add(a, b, true);
+}
+
+Decimal operator*(const Decimal &a, const Decimal &b) {
+    if (!a.isValid() || !b.isValid())
+        return Decimal::invalid();
+#ifdef DECIMAL_INT128
+    Int128 product;
+    if (a.m_kind == Decimal::Small && b.m_kind == Decimal::Small
+            && !__builtin_mul_overflow(a.m_small, b.m_small, &product))
+        return DecimalArithmetic::fromSmall(product, a.m_scale + b.m_scale);
+#endif
+    return DecimalArithmetic::multiply(a, b);
+}
+
+Decimal operator/(const Decimal &a, const Decimal &b) {
+    if (!a.isValid() || !b.isValid() || DecimalArithmetic::isZero(b))
+        return Decimal::invalid();
+#ifdef DECIMAL_INT128
+    if (a.m_kind == Decimal::Small && b.m_kind == Decimal::Small) {
+        const int exponent = Decimal::kDivisionScale + b.m_scale - a.m_scale;
+        UInt128 n = magnitude(a.m_small);
+        UInt128 d = magnitude(b.m_small);
+        if (exponent >= 0 ? scaleUp(n, exponent) : scaleUp(d, -exponent)) {
+            UInt128 quotient = n / d;
+            const UInt128 remainder = n % d;
+            if (remainder >= d - remainder)
+                ++quotient;
+            return DecimalArithmetic::fromWide(quotient, (a.m_small < 0) != (b.m_small < 0),
+                                               Decimal::kDivisionScale);
+        }
+    }
+#endif
+    return DecimalArithmetic::divide(a, b);
+}
+
+Decimal::PoolStatistics Decimal::poolStatistics() {
+    return LimbPool::instance().statistics();
+}
@@ -0,0 +1,84 @@
+// decimal.h
+
+#ifndef DECIMAL_H
+#define DECIMAL_H
+
+#include <QtCore>
+
+#if defined(__SIZEOF_INT128__)
+#  define DECIMAL_INT128
+#endif
+
+// A decimal number: an integer coefficient over a power of ten. Anything
+// typed in decimal, like 0.1, is held exactly, and so are sums,
+// differences and products. Quotients are rounded to kDivisionScale
+// decimal places.
+//
+// Where the compiler has 128-bit integers, a coefficient that fits in one
+// is held inline and computed with plain integer instructions. That covers
+// anything typed on a keypad and most results. Larger coefficients are
+// held in 32-bit limbs from a pool, which keeps freed blocks for reuse
+// instead of returning them to the heap.
+class Decimal {
+public:
+    static const int kDivisionScale = 20;
+
+    Decimal() = default;
+    Decimal(const Decimal &other);
+    Decimal(Decimal &&other) noexcept;
+    ~Decimal();
+    Decimal &operator=(const Decimal &other);
+    Decimal &operator=(Decimal &&other) noexcept;
+    void swap(Decimal &other) noexcept;
+
+    // Digits with an optional sign, point and exponent, as in "-1.5e3".
+    // Anything else gives an invalid Decimal.
+    static Decimal fromString(QStringView text);
+    static Decimal invalid();
+
+    // False for bad text and division by zero; any result computed from
+    // an invalid Decimal is invalid too.
+    bool isValid() const { return m_kind != Invalid; }
+    // True while the coefficient is held inline.
+    bool isSmall() const { return m_kind == Small; }
+
+    // Positional notation without trailing zeros, as in "-1500" or "0.3";
+    // empty if invalid.
+    QString toString() const;
+
+    // Rounded half away from zero to 'scale' decimal places.
+    Decimal rounded(int scale) const;
+
+    Decimal operator-() const;
+    friend Decimal operator+(const Decimal &a, const Decimal &b);
+    friend Decimal operator-(const Decimal &a, const Decimal &b);
+    friend Decimal operator*(const Decimal &a, const Decimal &b);
+    friend Decimal operator/(const Decimal &a, const Decimal &b);
+
+    // Counts for the limb pool since start-up: blocks handed out, and how
+    // many of those had to come from the heap.
+    struct PoolStatistics {
+        qint64 allocations = 0;
+        qint64 heapAllocations = 0;
+    };
+    static PoolStatistics poolStatistics();
+
+private:
+    friend class DecimalArithmetic;
+
+    enum Kind : quint8 { Small, Big, Invalid };
+
+#ifdef DECIMAL_INT128
+    __extension__ typedef __int128 Coefficient;
+    Coefficient m_small = 0;
+    Kind m_kind = Small;
+#else
+    Kind m_kind = Big;
+#endif
+    bool m_negative = false;    // Big only
+    int m_scale = 0;            // the value is the coefficient / 10^m_scale
+    int m_size = 0;             // Big: limbs in use, none for zero
+    quint32 *m_limbs = nullptr; // Big: the coefficient's magnitude, least significant first
+};
+
+#endif // DECIMAL_H
@@ -0,0 +1,378 @@
+// expression.cpp
+
+#include "expression.h"
+
+#include <algorithm>
+#include <vector>
+
+#ifdef __SSE2__
+#  define EXPRESSION_SSE2
+#  include <emmintrin.h>
+#endif
+
+namespace {
+
+// One byte per instruction; the push instructions are followed by a 16 bit
+// index into the constants or variables.
+enum Opcode : quint8 { PushConstant, PushVariable, Add, Subtract, Multiply, Divide, Negate };
+
+inline int operand(const uchar *pc) {
+    return pc[0] | pc[1] << 8;
+}
+
+// Rows per block in batch evaluation: long enough to amortize dispatching
+// each instruction, short enough that a block's stack stays in cache.
+const int kBlockRows = 256;
+
+struct AddOp {
+    static double apply(double a, double b) { return a + b; }
+#ifdef EXPRESSION_SSE2
+    static __m128d apply(__m128d a, __m128d b) { return _mm_add_pd(a, b); }
+#endif
+};
+
+struct SubtractOp {
+    static double apply(double a, double b) { return a - b; }
+#ifdef EXPRESSION_SSE2
+    static __m128d apply(__m128d a, __m128d b) { return _mm_sub_pd(a, b); }
+#endif
+};
+
+struct MultiplyOp {
+    static double apply(double a, double b) { return a * b; }
+#ifdef EXPRESSION_SSE2
+    static __m128d apply(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
+#endif
+};
+
+struct DivideOp {
+    static double apply(double a, double b) { return a / b; }
+#ifdef EXPRESSION_SSE2
+    static __m128d apply(__m128d a, __m128d b) { return _mm_div_pd(a, b); }
+#endif
+};
+
+// 'out' may be 'a'. Each lane does exactly what the scalar code does, so
+// batch results equal evaluate()'s.
+template <typename Op>
+void binaryKernel(double *out, const double *a, const double *b, int count) {
+    int i = 0;
+#ifdef EXPRESSION_SSE2
+    for (; i + 2 <= count; i += 2)
+        _mm_storeu_pd(out + i, Op::apply(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+#endif
+    for (; i < count; ++i)
+        out[i] = Op::apply(a[i], b[i]);
+}
+
+void negateKernel(double *out, const double *a, int count) {
+    for (int i = 0; i < count; ++i)
+        out[i] = -a[i];
+}
+
+} // namespace
+
+// Recursive descent over the source, emitting code in postfix order.
+class ExpressionCompiler {
+public:
+    explicit ExpressionCompiler(const QString &source) : m_source(source) {}
+
+    Expression run() {
+        parseSum();
+        skipSpaces();
+        if (m_error.isEmpty() && m_pos < m_source.size())
+            fail(QStringLiteral("unexpected '%1'").arg(m_source.at(m_pos)));
+        if (!m_error.isEmpty()) {
+            Expression invalid;
+            invalid.m_errorString = QStringLiteral("%1 at position %2").arg(m_error).arg(m_pos + 1);
+            return invalid;
+        }
+        return m_expression;
+    }
+
+private:
+    void skipSpaces() {
+        while (m_pos < m_source.size() && m_source.at(m_pos).isSpace())
+            ++m_pos;
+    }
+
+    bool take(QChar c) {
+        skipSpaces();
+        if (m_pos < m_source.size() && m_source.at(m_pos) == c) {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+    void fail(const QString &error) {
+        if (m_error.isEmpty())
+            m_error = error;
+    }
+
+    void parseSum() {
+        parseProduct();
+        while (m_error.isEmpty()) {
+            if (take('+')) {
+                parseProduct();
+                emitBinary(Add);
+            } else if (take('-')) {
+                parseProduct();
+                emitBinary(Subtract);
+            } else {
+                break;
+            }
+        }
+    }
+
+    void parseProduct() {
+        parseUnary();
+        while (m_error.isEmpty()) {
+            if (take('*')) {
+                parseUnary();
+                emitBinary(Multiply);
+            } else if (take('/')) {
+                parseUnary();
+                emitBinary(Divide);
+            } else {
+                break;
+            }
+        }
+    }
+
+    void parseUnary() {
+        if (take('-')) {
+            parseUnary();
+            m_expression.m_code.append(char(Negate));
+        } else if (take('+')) {
+            parseUnary();
+        } else {
+            parsePrimary();
+        }
+    }
+
+    void parsePrimary() {
+        skipSpaces();
+        if (m_pos >= m_source.size()) {
+            fail(QStringLiteral("expression ends early"));
+            return;
+        }
+        const QChar c = m_source.at(m_pos);
+        if (c == '(') {
+            ++m_pos;
+            parseSum();
+            if (m_error.isEmpty() && !take(')'))
+                fail(QStringLiteral("missing ')'"));
+        } else if (c.isDigit() || c == '.') {
+            parseNumber();
+        } else if (c.isLetter() || c == '_') {
+            const int start = m_pos;
+            while (m_pos < m_source.size() && (m_source.at(m_pos).isLetterOrNumber() || m_source.at(m_pos) == '_'))
+                ++m_pos;
+            const QString name = m_source.mid(start, m_pos - start);
+            int index = m_expression.m_variables.indexOf(name);
+            if (index < 0) {
+                index = m_expression.m_variables.size();
+                m_expression.m_variables.append(name);
+            }
+            emitPush(PushVariable, index);
+        } else {
+            fail(QStringLiteral("unexpected '%1'").arg(c));
+        }
+    }
+
+    void parseNumber() {
+        const int start = m_pos;
+        while (m_pos < m_source.size() && (m_source.at(m_pos).isDigit() || m_source.at(m_pos) == '.'))
+            ++m_pos;
+        // An exponent only if digits follow, so "2e" is an error later on.
+        if (m_pos + 1 < m_source.size() && (m_source.at(m_pos) == 'e' || m_source.at(m_pos) == 'E')) {
+            int end = m_pos + 1;
+            if (end < m_source.size() && (m_source.at(end) == '+' || m_source.at(end) == '-'))
+                ++end;
+            if (end < m_source.size() && m_source.at(end).isDigit()) {
+                m_pos = end;
+                while (m_pos < m_source.size() && m_source.at(m_pos).isDigit())
+                    ++m_pos;
+            }
+        }
+
+        const QString text = m_source.mid(start, m_pos - start);
+        bool ok;
+        const double value = text.toDouble(&ok);
+        const Decimal exact = Decimal::fromString(text);
+        if (!ok || !exact.isValid()) {
+            m_pos = start;
+            fail(QStringLiteral("invalid number"));
+            return;
+        }
+        m_expression.m_constants.append(value);
+        m_expression.m_exactConstants.append(exact);
+        emitPush(PushConstant, m_expression.m_constants.size() - 1);
+    }
+
+    void emitPush(Opcode op, int index) {
+        if (index > 0xffff) {
+            fail(QStringLiteral("expression too long"));
+            return;
+        }
+        m_expression.m_code.append(char(op));
+        m_expression.m_code.append(char(index & 0xff));
+        m_expression.m_code.append(char(index >> 8));
+        m_expression.m_stackDepth = qMax(m_expression.m_stackDepth, ++m_depth);
+    }
+
+    void emitBinary(Opcode op) {
+        m_expression.m_code.append(char(op));
+        --m_depth;
+    }
+
+    const QString m_source;
+    int m_pos = 0;
+    int m_depth = 0;
+    QString m_error;
+    Expression m_expression;
+};
+
+Expression Expression::compile(const QString &source) {
+    return ExpressionCompiler(source).run();
+}
+
+double Expression::evaluate(const double *values) const {
+    if (!isValid() || (values == nullptr && !m_variables.isEmpty()))
+        return qQNaN();
+
+    QVarLengthArray<double, 32> stack(m_stackDepth);
+    double *top = stack.data() - 1;
+    const uchar *pc = reinterpret_cast<const uchar *>(m_code.constData());
+    const uchar *end = pc + m_code.size();
+    while (pc < end) {
+        switch (*pc++) {
+        case PushConstant:
+            *++top = m_constants.at(operand(pc));
+            pc += 2;
+            break;
+        case PushVariable:
+            *++top = values[operand(pc)];
+            pc += 2;
+            break;
+        case Add:
+            --top;
+            top[0] = AddOp::apply(top[0], top[1]);
+            break;
+        case Subtract:
+            --top;
+            top[0] = SubtractOp::apply(top[0], top[1]);
+            break;
+        case Multiply:
+            --top;
+            top[0] = MultiplyOp::apply(top[0], top[1]);
+            break;
+        case Divide:
+            --top;
+            top[0] = DivideOp::apply(top[0], top[1]);
+            break;
+        case Negate:
+            top[0] = -top[0];
+            break;
+        }
+    }
+    return *top;
+}
+
+Decimal Expression::evaluateExact(const Decimal *values) const {
+    if (!isValid() || (values == nullptr && !m_variables.isEmpty()))
+        return Decimal::invalid();
+
+    QVarLengthArray<Decimal, 16> stack(m_stackDepth);
+    int top = -1;
+    const uchar *pc = reinterpret_cast<const uchar *>(m_code.constData());
+    const uchar *end = pc + m_code.size();
+    while (pc < end) {
+        switch (*pc++) {
+        case PushConstant:
+            stack[++top] = m_exactConstants.at(operand(pc));
+            pc += 2;
+            break;
+        case PushVariable:
+            stack[++top] = values[operand(pc)];
+            pc += 2;
+            break;
+        case Add:
+            --top;
+            stack[top] = stack[top] + stack[top + 1];
+            break;
+        case Subtract:
+            --top;
+            stack[top] = stack[top] - stack[top + 1];
+            break;
+        case Multiply:
+            --top;
+            stack[top] = stack[top] * stack[top + 1];
+            break;
+        case Divide:
+            --top;
+            stack[top] = stack[top] / stack[top + 1];
+            break;
+        case Negate:
+            stack[top] = -stack[top];
+            break;
+        }
+    }
+    return std::move(stack[0]);
+}
+
+void Expression::evaluateBatch(const double *const *columns, int rows, double *results) const {
+    if (!isValid() || (columns == nullptr && !m_variables.isEmpty())) {
+        std::fill(results, results + rows, qQNaN());
+        return;
+    }
+
+    // Each stack entry points at its block of values: a variable's column
+    // where it is pushed, otherwise the entry's own scratch row.
+    std::vector<double> scratch(size_t(m_stackDepth) * kBlockRows);
+    QVarLengthArray<const double *, 32> stack(m_stackDepth);
+    const uchar *code = reinterpret_cast<const uchar *>(m_code.constData());
+    const uchar *end = code + m_code.size();
+
+    for (int first = 0; first < rows; first += kBlockRows) {
+        const int count = qMin(kBlockRows, rows - first);
+        int top = -1;
+        for (const uchar *pc = code; pc < end;) {
+            switch (*pc++) {
+            case PushConstant: {
+                double *out = scratch.data() + size_t(++top) * kBlockRows;
+                std::fill(out, out + count, m_constants.at(operand(pc)));
+                stack[top] = out;
+                pc += 2;
+                break;
+            }
+            case PushVariable:
+                stack[++top] = columns[operand(pc)] + first;
+                pc += 2;
+                break;
+            case Negate: {
+                double *out = scratch.data() + size_t(top) * kBlockRows;
+                negateKernel(out, stack[top], count);
+                stack[top] = out;
+                break;
+            }
+            default: {
+                const quint8 op = pc[-1];
+                double *out = scratch.data() + size_t(--top) * kBlockRows;
+                if (op == Add)
+                    binaryKernel<AddOp>(out, stack[top], stack[top + 1], count);
+                else if (op == Subtract)
+                    binaryKernel<SubtractOp>(out, stack[top], stack[top + 1], count);
+                else if (op == Multiply)
+                    binaryKernel<MultiplyOp>(out, stack[top], stack[top + 1], count);
+                else
+                    binaryKernel<DivideOp>(out, stack[top], stack[top + 1], count);
+                stack[top] = out;
+                break;
+            }
+            }
+        }
+        std::copy(stack[0], stack[0] + count, results + first);
+    }
+}
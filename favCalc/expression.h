@@ -0,0 +1,54 @@
+// expression.h
+
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <QtCore>
+
+#include "decimal.h"
+
+// An arithmetic expression compiled to bytecode for a small stack machine:
+// numbers, named variables, + - * / with the usual precedence, unary minus
+// and parentheses. Compiling checks the syntax and works out how deep the
+// stack gets, so evaluating needs no checks.
+//
+// evaluate() runs the code once for one set of variable values.
+// evaluateBatch() runs it over columns of values, a block of rows per
+// instruction, so the arithmetic happens in tight loops over arrays that
+// the compiler turns into vector instructions.
+class Expression {
+public:
+    Expression() = default;
+
+    static Expression compile(const QString &source);
+
+    bool isValid() const { return m_errorString.isEmpty() && !m_code.isEmpty(); }
+    QString errorString() const { return m_errorString; }
+
+    // In order of first use; their values are passed in this order.
+    QStringList variables() const { return m_variables; }
+
+    int codeSize() const { return m_code.size(); }
+
+    double evaluate(const double *values = nullptr) const;
+
+    // The same in Decimal arithmetic, exact where evaluate() rounds to
+    // binary: 0.1 + 0.2 gives 0.3.
+    Decimal evaluateExact(const Decimal *values = nullptr) const;
+
+    // columns[v][row] is the value of variable v in 'row'; results[row]
+    // receives the result for each of the 'rows' rows.
+    void evaluateBatch(const double *const *columns, int rows, double *results) const;
+
+private:
+    friend class ExpressionCompiler;
+
+    QByteArray m_code;
+    QList<double> m_constants;
+    QList<Decimal> m_exactConstants;
+    QStringList m_variables;
+    int m_stackDepth = 0;
+    QString m_errorString;
+};
+
+#endif // EXPRESSION_H
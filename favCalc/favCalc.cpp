@@ -2,6 +2,29 @@
 
 #include <QtWidgets>
 #include <cmath>
+#include <cstring>
+
+#include "collisionsolver.h"
+#include "decimal.h"
+#include "expression.h"
+#include "labelcache.h"
+#include "mousetrace.h"
+#include "nodebatchitem.h"
+#include "nodestore.h"
+#include "simulationloop.h"
+#include "spatialgrid.h"
+
+static const qreal kNodeRadius = 30.0;
+static const qreal kSpacing = 70.0;
+static const qreal kStartX = -105.0;
+static const qreal kStartY = -100.0;
+// Nodes closer to the mouse than this are pushed away.
+static const qreal kRepulsionRadius = 50.0;
+static const int kStepsPerSecond = 120;
+// Once a step moves no node further than this, the scene is at rest.
+static const qreal kRestingMotion = 0.001;
+// Decimal places shown for a result; the entry carries on with all of them.
+static const int kDisplayScale = 12;
 
 struct ButtonDef {
     QString label;
@@ -16,77 +39,256 @@ const QList<ButtonDef> calculatorButtons = {
     {"C", {0, 4}},
 };
 
-class NNode : public QGraphicsEllipseItem {
+// One scene item per node, as the scene had them before the nodes were
+// batched; only used with the scene's BSP index.
+class NodeItem : public QGraphicsEllipseItem {
 public:
-    NNode(const QString &text, QPointF home) : label(text), homePos(home) {
-        setRect(-30, -30, 60, 60);
+    NodeItem(const QString &text, QPointF home) : label(text) {
+        setRect(-kNodeRadius, -kNodeRadius, 2 * kNodeRadius, 2 * kNodeRadius);
         setBrush(Qt::lightGray);
         setZValue(1);
-
-        QGraphicsTextItem *txt = new QGraphicsTextItem(text, this);
-        txt->setDefaultTextColor(Qt::black);
-        txt->setFont(QFont("Arial", 14, QFont::Bold));
-        QRectF r = txt->boundingRect();
-        txt->setPos(-r.width()/2, -r.height()/2);
-
         setPos(home);
     }
 
-    void updateWithMouse(const QPointF &mouse, qreal radius) {
-        QPointF delta = pos() - mouse;
-        qreal dx = delta.x();
-        qreal dy = delta.y();
-        qreal dist2 = dx * dx + dy * dy;
-
-        if (dist2 < radius * radius && dist2 > 0.1) {
-            qreal dist = std::sqrt(dist2);
-            qreal overlap = radius - dist;
-            qreal nx = dx / dist;
-            qreal ny = dy / dist;
-            QPointF away = QPointF(nx * overlap, ny * overlap);
-            setPos(pos() + away * 0.3); // respond with softness
-        } else {
-            // Glide back to home position
-            QPointF back = homePos - pos();
-            setPos(pos() + back * 0.1); // smooth return
-        }
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override {
+        QGraphicsEllipseItem::paint(painter, option, widget);
+        const qreal scale = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform())
+                * painter->device()->devicePixelRatioF();
+        // Held, so the cache lives on between paints; all items share it.
+        if (!labelCache || !qFuzzyCompare(scale, labelCache->scale()))
+            labelCache = LabelCache::get(QFont("Arial", 14, QFont::Bold), scale);
+        const QPixmap text = labelCache->pixmap(label);
+        painter->drawPixmap(-QPointF(text.width(), text.height()) / (2 * scale), text);
     }
 
 private:
     QString label;
-    QPointF homePos;
+    QSharedPointer<LabelCache> labelCache;
 };
 
+// Simulation state lives in a NodeStore; the items only show it.
+//
+// QGraphicsScene's default BSP index has to move every item that moves,
+// the worst case when all of them can move each frame. So by default the
+// scene has no item index and one item showing all the nodes, which takes
+// the moves of a whole frame in one call and repaints their union; hit
+// tests on nodes go through the spatial grid instead. BspIndex gives the
+// nodes one item each, in the index, to compare against.
 class Scene : public QGraphicsScene {
 public:
-    Scene(QObject *parent = nullptr) : QGraphicsScene(parent) {
-        setSceneRect(-250, -350, 500, 700);
+    enum IndexMode { DynamicIndex, BspIndex };
 
-        int spacing = 70;
-        int startX = -105;
-        int startY = -100;
+    Scene(IndexMode mode = DynamicIndex, QObject *parent = nullptr)
+        : QGraphicsScene(parent), indexMode(mode), grid(kRepulsionRadius), collisions(kNodeRadius),
+          loop(kStepsPerSecond) {
+        setSceneRect(-250, -350, 500, 700);
 
-        for (const ButtonDef &b : calculatorButtons) {
-            QPointF home(startX + b.gridPos.x() * spacing, startY + b.gridPos.y() * spacing);
-            NNode *n = new NNode(b.label, home);
-            nodes.append(n);
-            addItem(n);
+        if (indexMode == DynamicIndex) {
+            setItemIndexMethod(NoIndex);
+            batch = new NodeBatchItem(&store, kNodeRadius);
+            batch->setZValue(1);
+            addItem(batch);
         }
 
-        // Display rectangle (decorative)
+        for (const ButtonDef &b : calculatorButtons)
+            addNode(b.label, QPointF(kStartX + b.gridPos.x() * kSpacing, kStartY + b.gridPos.y() * kSpacing));
+        if (batch)
+            batch->updateNodes({});
+
         QGraphicsRectItem *display = new QGraphicsRectItem(-140, -250, 280, 60);
         display->setBrush(Qt::white);
         display->setPen(QPen(Qt::black, 2));
         addItem(display);
+        displayText = new QGraphicsSimpleTextItem(display);
+        displayText->setFont(QFont("Arial", 20));
+        showDisplay("0");
+
+        loop.setStepFunction([this] { return step(); });
+        loop.setFrameFunction([this] { syncItems(); });
+    }
+
+    // More nodes in rows below the keypad, labelled like its keys.
+    void addTokens(int count) {
+        if (count <= 0)
+            return;
+        const int columns = qCeil(std::sqrt(qreal(count)));
+        const qreal top = kStartY + 6 * kSpacing;
+        for (int i = 0; i < count; ++i) {
+            const QString &label = calculatorButtons.at(i % calculatorButtons.size()).label;
+            addNode(label, QPointF(kStartX + (i % columns) * kSpacing, top + (i / columns) * kSpacing));
+        }
+        if (batch)
+            batch->updateNodes({});
+        setSceneRect(sceneRect() | tokenRect(count).adjusted(-kSpacing, -kSpacing, kSpacing, kSpacing));
+    }
+
+    // Where addTokens() puts that many nodes' centers.
+    static QRectF tokenRect(int count) {
+        const int columns = qCeil(std::sqrt(qreal(qMax(1, count))));
+        const int rows = (qMax(1, count) + columns - 1) / columns;
+        return QRectF(kStartX, kStartY + 6 * kSpacing, (columns - 1) * kSpacing, (rows - 1) * kSpacing);
+    }
+
+    // The node under 'pos', or -1.
+    int nodeAt(const QPointF &pos) const {
+        int found = -1;
+        if (indexMode == BspIndex) {
+            for (QGraphicsItem *item : items(pos)) {
+                if (item->data(0).isValid())
+                    return item->data(0).toInt();
+            }
+            return found;
+        }
+        const qreal radius2 = kNodeRadius * kNodeRadius;
+        grid.query(pos, kNodeRadius, [this, &pos, &found, radius2](int id) {
+            const QPointF delta = store.pos(id) - pos;
+            if (QPointF::dotProduct(delta, delta) <= radius2)
+                found = qMax(found, id); // the topmost, as drawn last
+        });
+        return found;
+    }
+
+    // Headless runs step the simulation themselves, at their own pace.
+    void setManualStepping(bool manual) {
+        manualStepping = manual;
+    }
+
+    void advance() {
+        step();
+        syncItems();
+    }
+
+    // Replays drive the loop on their own clock, as the live scene's timer
+    // would.
+    SimulationLoop &simulationLoop() {
+        return loop;
+    }
+
+    QList<QPointF> nodePositions() const {
+        QList<QPointF> positions;
+        for (int id = 0; id < store.size(); ++id)
+            positions.append(store.pos(id));
+        return positions;
+    }
+
+    // Input only takes effect at the next simulation step, so however fast
+    // the mouse reports, the latest position is all that counts.
+    void setMousePosition(const QPointF &pos) {
+        mouse = pos;
+        hasMouse = true;
+        if (!manualStepping)
+            loop.wake();
+    }
+
+    void clearMousePosition() {
+        hasMouse = false;
+        if (!manualStepping)
+            loop.wake();
     }
 
-    void updateNodePositions(const QPointF &mouse) {
-        for (NNode *n : nodes)
-            n->updateWithMouse(mouse, 50.0);
+    // Keys build up an expression in the display and '=' evaluates it. A
+    // digit after a result starts over; an operator carries on from it.
+    void pressNode(int id) {
+        if (id >= 0)
+            pressKey(labels.at(id));
+    }
+
+    void pressKey(const QString &key) {
+        if (key == QLatin1String("C")) {
+            entry.clear();
+            showingResult = false;
+            showDisplay("0");
+            return;
+        }
+        if (key == QLatin1String("=")) {
+            const Decimal value = Expression::compile(entry).evaluateExact();
+            entry = value.toString();
+            showingResult = true;
+            showDisplay(value.isValid() ? value.rounded(kDisplayScale).toString() : QStringLiteral("Error"));
+            return;
+        }
+        if (showingResult && (key.at(0).isDigit() || key == QLatin1String(".")))
+            entry.clear();
+        showingResult = false;
+        entry += key;
+        showDisplay(entry);
+    }
+
+    NodeBatchItem::LabelStatistics labelStatistics() const {
+        return batch ? batch->labelStatistics() : NodeBatchItem::LabelStatistics();
     }
 
 private:
-    QList<NNode *> nodes;
+    void showDisplay(const QString &text) {
+        const QRectF display = displayText->parentItem()->boundingRect().adjusted(10, 0, -10, 0);
+        const QFontMetricsF metrics(displayText->font());
+        displayText->setText(metrics.elidedText(text, Qt::ElideLeft, display.width()));
+        const QRectF textRect = displayText->boundingRect();
+        displayText->setPos(display.right() - textRect.width(), display.center().y() - textRect.height() / 2);
+    }
+
+    void addNode(const QString &label, const QPointF &home) {
+        const int id = store.add(home);
+        labels.append(label);
+        grid.insert(id, home);
+        if (batch) {
+            batch->setLabel(id, label);
+        } else {
+            nodeItems.append(new NodeItem(label, home));
+            nodeItems.last()->setData(0, id);
+            addItem(nodeItems.last());
+        }
+    }
+
+    // Only steps the nodes near the mouse and those still on their way
+    // home, however many there are in total. Collisions are only solved
+    // among those and the nodes they could touch, so resting nodes cost
+    // nothing; once pushed, a node is active and pushes others in turn.
+    bool step() {
+        if (hasMouse)
+            grid.query(mouse, kRepulsionRadius, [this](int id) { store.activate(id); });
+        qreal moved = store.step(mouse, hasMouse ? kRepulsionRadius : 0);
+        const int active = store.activeCount();
+        if (active > 0) {
+            // The grid has positions as of the last sync; a pair it misses
+            // is caught on a later step, as the moving node stays active.
+            // Activating only appends to the active slots.
+            for (int slot = 0; slot < active; ++slot) {
+                const QPointF pos(store.slotX()[slot], store.slotY()[slot]);
+                grid.query(pos, 2 * kNodeRadius, [this](int id) { store.activate(id); });
+            }
+            collisions.solve(store.slotX(), store.slotY(), store.activeCount());
+            moved = qMax(moved, store.displace(collisions.dx(), collisions.dy(), store.activeCount()));
+        }
+        return moved > kRestingMotion;
+    }
+
+    void syncItems() {
+        const QList<int> moved = store.takeMoved();
+        for (int id : moved)
+            grid.move(id, store.pos(id));
+        if (batch) {
+            batch->updateNodes(moved);
+        } else {
+            for (int id : moved)
+                nodeItems.at(id)->setPos(store.pos(id));
+        }
+    }
+
+    IndexMode indexMode;
+    NodeStore store;
+    NodeBatchItem *batch = nullptr;
+    QList<QGraphicsItem *> nodeItems; // BspIndex only
+    QStringList labels;               // per node id
+    SpatialGrid grid;
+    CollisionSolver collisions;
+    SimulationLoop loop;
+    QPointF mouse;
+    bool hasMouse = false;
+    bool manualStepping = false;
+    QGraphicsSimpleTextItem *displayText = nullptr;
+    QString entry;
+    bool showingResult = false;
 };
 
 class View : public QGraphicsView {
@@ -97,22 +299,501 @@ public:
         setBackgroundBrush(QColor(220, 220, 220));
     }
 
+    // Mouse moves go into 'trace' as well from now on.
+    void record(MouseTrace *trace) {
+        recording = trace;
+        traceClock.start();
+    }
+
 protected:
     void mouseMoveEvent(QMouseEvent *event) override {
         QPointF sceneMouse = mapToScene(event->pos());
-        sc->updateNodePositions(sceneMouse);
+        if (recording)
+            recording->addMove(traceClock.nsecsElapsed(), sceneMouse);
+        sc->setMousePosition(sceneMouse);
         QGraphicsView::mouseMoveEvent(event);
     }
 
+    void mousePressEvent(QMouseEvent *event) override {
+        if (event->button() == Qt::LeftButton)
+            sc->pressNode(sc->nodeAt(mapToScene(event->pos())));
+        QGraphicsView::mousePressEvent(event);
+    }
+
+    void keyPressEvent(QKeyEvent *event) override {
+        const QString text = event->text();
+        if (event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter)
+            sc->pressKey("=");
+        else if (event->key() == Qt::Key_Escape)
+            sc->pressKey("C");
+        else if (text.size() == 1 && QStringLiteral("0123456789.+-*/=").contains(text))
+            sc->pressKey(text);
+        else
+            QGraphicsView::keyPressEvent(event);
+    }
+
+    void leaveEvent(QEvent *event) override {
+        if (recording)
+            recording->addLeave(traceClock.nsecsElapsed());
+        sc->clearMousePosition();
+        QGraphicsView::leaveEvent(event);
+    }
+
 private:
     Scene *sc;
+    MouseTrace *recording = nullptr;
+    QElapsedTimer traceClock;
 };
 
+// Node counts and frames per benchmark run; the mouse sweeps once across
+// the nodes below the keypad, pushing them into each other.
+static const int benchmarkCounts[] = { 1000, 4000, 16000 };
+static const int kBenchmarkFrames = 240;
+static const int kHitTests = 10000;
+
+// Steps, syncs and renders a view-sized area around the mouse per frame,
+// in both index modes, and prints the costs as JSON.
+static int runBenchmark() {
+    QJsonArray results;
+    for (int count : benchmarkCounts) {
+        for (Scene::IndexMode mode : { Scene::BspIndex, Scene::DynamicIndex }) {
+            Scene scene(mode);
+            scene.setManualStepping(true);
+            scene.addTokens(count);
+
+            const QRectF tokens = Scene::tokenRect(count);
+            QImage image(600, 800, QImage::Format_ARGB32_Premultiplied);
+            auto renderAround = [&](const QPointF &center) {
+                image.fill(Qt::white);
+                QPainter painter(&image);
+                painter.setRenderHint(QPainter::Antialiasing);
+                const QRectF source(center - QPointF(image.width() / 2.0, image.height() / 2.0), image.size());
+                scene.render(&painter, QRectF(image.rect()), source);
+            };
+            renderAround(tokens.center());
+
+            qint64 stepTime = 0;
+            qint64 renderTime = 0;
+            QElapsedTimer timer;
+            for (int frame = 0; frame < kBenchmarkFrames; ++frame) {
+                const QPointF mouse(tokens.left() + tokens.width() * frame / (kBenchmarkFrames - 1),
+                                    tokens.center().y());
+                timer.start();
+                scene.setMousePosition(mouse);
+                scene.advance();
+                stepTime += timer.nsecsElapsed();
+                timer.start();
+                renderAround(mouse);
+                renderTime += timer.nsecsElapsed();
+            }
+
+            QRandomGenerator random(1);
+            int hits = 0;
+            timer.start();
+            for (int i = 0; i < kHitTests; ++i) {
+                const QPointF pos(tokens.left() + random.generateDouble() * tokens.width(),
+                                  tokens.top() + random.generateDouble() * tokens.height());
+                hits += scene.nodeAt(pos) >= 0;
+            }
+            const qint64 hitTime = timer.nsecsElapsed();
+
+            QJsonObject result;
+            result["index"] = mode == Scene::BspIndex ? "bsp" : "none";
+            result["nodes"] = count + int(calculatorButtons.size());
+            result["frames"] = kBenchmarkFrames;
+            result["nsPerStep"] = double(stepTime) / kBenchmarkFrames;
+            result["nsPerRender"] = double(renderTime) / kBenchmarkFrames;
+            result["nsPerHitTest"] = double(hitTime) / kHitTests;
+            result["hitRate"] = double(hits) / kHitTests;
+            results.append(result);
+        }
+    }
+    QTextStream(stdout) << QJsonDocument(results).toJson();
+    return 0;
+}
+
+// Evaluates 'source' over 'rows' rows of made-up variable values, one row at
+// a time and then in batches, and prints the rate of each.
+static int runEvaluation(const QString &source, int rows) {
+    const Expression expression = Expression::compile(source);
+    if (!expression.isValid()) {
+        qWarning("%s", qPrintable(expression.errorString()));
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    const QStringList variables = expression.variables();
+    out << "code: " << expression.codeSize() << " bytes, variables: "
+        << (variables.isEmpty() ? QStringLiteral("none") : variables.join(' ')) << Qt::endl;
+    if (variables.isEmpty()) {
+        out << "result: " << QString::number(expression.evaluate(), 'g', 17) << Qt::endl;
+        const Decimal exact = expression.evaluateExact();
+        out << "exact: " << (exact.isValid() ? exact.toString() : QStringLiteral("invalid")) << Qt::endl;
+    }
+
+    QList<QList<double>> columns(variables.size());
+    QList<const double *> columnData;
+    for (int v = 0; v < columns.size(); ++v) {
+        columns[v].resize(rows);
+        for (int row = 0; row < rows; ++row)
+            columns[v][row] = v + 1 + (row % 1000) * 0.001;
+        columnData.append(columns.at(v).constData());
+    }
+    QList<double> results(rows);
+    QList<double> values(variables.size());
+
+    QElapsedTimer timer;
+    timer.start();
+    double sum = 0;
+    for (int row = 0; row < rows; ++row) {
+        for (int v = 0; v < columns.size(); ++v)
+            values[v] = columns.at(v).at(row);
+        sum += expression.evaluate(values.constData());
+    }
+    const qint64 singleTime = qMax<qint64>(1, timer.nsecsElapsed());
+
+    timer.start();
+    expression.evaluateBatch(columnData.constData(), rows, results.data());
+    const qint64 batchTime = qMax<qint64>(1, timer.nsecsElapsed());
+
+    double batchSum = 0;
+    for (double result : std::as_const(results))
+        batchSum += result;
+    out << "rows: " << rows << ", sum: " << QString::number(sum, 'g', 17)
+        << (batchSum == sum || (qIsNaN(sum) && qIsNaN(batchSum)) ? "" : " (batch sum differs!)") << Qt::endl;
+    out << "single: " << qRound64(rows * 1e9 / singleTime) << " evaluations/s" << Qt::endl;
+    out << "batch: " << qRound64(rows * 1e9 / batchTime) << " evaluations/s" << Qt::endl;
+    return 0;
+}
+
+// Trace time a replay keeps stepping after the last event, waiting for the
+// scene to come to rest.
+static const qint64 kReplaySettleTime = 10000000000LL;
+
+static QJsonObject percentiles(QList<qint64> samples) {
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](qreal fraction) {
+        return samples.isEmpty() ? 0.0 : double(samples.at(qMax(0, qCeil(fraction * samples.size()) - 1)));
+    };
+    QJsonObject result;
+    result["p50"] = at(0.5);
+    result["p90"] = at(0.9);
+    result["p99"] = at(0.99);
+    result["max"] = at(1.0);
+    return result;
+}
+
+// Plays a recorded trace into a scene without a window. The loop ticks at
+// its timer's interval in trace time, however long each tick takes here,
+// so a trace always steps the scene the same way and ends with the same
+// positions. Each tick that steps renders the recorded viewport, as the
+// view would repaint.
+//
+// A frame's latency is the time its tick and render take. An event's is
+// how long after it, in trace time, the loop next stepped, plus the
+// latency of that frame: when the event would have shown on screen.
+static int runReplay(const QString &fileName, Scene::IndexMode mode) {
+    MouseTrace trace;
+    if (!trace.load(fileName)) {
+        qWarning("%s", qPrintable(trace.errorString()));
+        return 1;
+    }
+
+    Scene scene(mode);
+    scene.addTokens(trace.tokens());
+    SimulationLoop &loop = scene.simulationLoop();
+    qint64 now = 0;
+    loop.setManualClock([&now] { return now; });
+
+    const QSize size = trace.viewportSize().isEmpty() ? QSize(600, 800) : trace.viewportSize();
+    const QRectF viewport = trace.viewportRect().isEmpty() ? scene.sceneRect() : trace.viewportRect();
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    auto render = [&] {
+        image.fill(Qt::white);
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        scene.render(&painter, QRectF(image.rect()), viewport);
+    };
+    render();
+
+    QList<qint64> frameLatencies;
+    QList<qint64> eventLatencies;
+    QList<qint64> pending; // times of the events no step has seen yet
+    auto frameShown = [&](qint64 latency) {
+        frameLatencies.append(latency);
+        for (qint64 time : std::as_const(pending))
+            eventLatencies.append(now - time + latency);
+        pending.clear();
+    };
+
+    QElapsedTimer timer;
+    qint64 nextTick = 0;
+    auto tickUntil = [&](qint64 limit) {
+        while (!loop.isSleeping() && nextTick <= limit) {
+            now = nextTick;
+            nextTick += loop.tickInterval();
+            timer.start();
+            if (loop.tick() > 0) {
+                render();
+                frameShown(timer.nsecsElapsed());
+            }
+        }
+    };
+
+    for (const MouseTrace::Event &event : trace.events()) {
+        const qint64 time = event.time * 1000;
+        tickUntil(time);
+        now = time;
+        pending.append(time);
+        const bool waking = loop.isSleeping();
+        timer.start();
+        if (event.leave)
+            scene.clearMousePosition();
+        else
+            scene.setMousePosition(event.pos);
+        if (waking) {
+            // Waking steps right away; the timer starts from here.
+            render();
+            frameShown(timer.nsecsElapsed());
+            nextTick = time + loop.tickInterval();
+        }
+    }
+    const qint64 end = now;
+    tickUntil(end + kReplaySettleTime);
+
+    QJsonArray positions;
+    for (const QPointF &pos : scene.nodePositions())
+        positions.append(QJsonArray{ pos.x(), pos.y() });
+    QJsonObject result;
+    result["trace"] = fileName;
+    result["index"] = mode == Scene::BspIndex ? "bsp" : "none";
+    result["nodes"] = int(positions.size());
+    result["events"] = int(trace.events().size());
+    result["traceMs"] = double(end) / 1000000;
+    result["steps"] = loop.stepCount();
+    result["frames"] = int(frameLatencies.size());
+    result["settled"] = loop.isSleeping();
+    result["eventLatencyNs"] = percentiles(eventLatencies);
+    result["frameLatencyNs"] = percentiles(frameLatencies);
+    result["positions"] = positions;
+    QTextStream(stdout) << QJsonDocument(result).toJson();
+    return 0;
+}
+
+// What gets typed on the keypad, then two products too long for 128 bits.
+static const char *const decimalBenchmarkExpressions[] = {
+    "0.1+0.2", "12.5*4-7.25", "1234.56*789", "100/8", "1/3", "2/3*3", "-45.5+0.05*12",
+    "123456789012345678901234567890*987654321098765432109876543210",
+    "1/7*99999999999999999999999999",
+};
+static const int kDecimalIterations = 100000;
+
+// Times each expression with doubles and with Decimals, and counts the limb
+// blocks the Decimals needed: none while the 128-bit path holds, and for
+// the rest, blocks reused from the pool rather than the heap.
+static int runDecimalBenchmark() {
+    QJsonArray results;
+    for (const char *source : decimalBenchmarkExpressions) {
+        const Expression expression = Expression::compile(QString::fromLatin1(source));
+        QElapsedTimer timer;
+
+        double sum = 0;
+        timer.start();
+        for (int i = 0; i < kDecimalIterations; ++i)
+            sum += expression.evaluate();
+        const qint64 doubleTime = timer.nsecsElapsed();
+
+        const Decimal::PoolStatistics before = Decimal::poolStatistics();
+        Decimal exact;
+        timer.start();
+        for (int i = 0; i < kDecimalIterations; ++i)
+            exact = expression.evaluateExact();
+        const qint64 exactTime = timer.nsecsElapsed();
+        const Decimal::PoolStatistics after = Decimal::poolStatistics();
+
+        QJsonObject result;
+        result["expression"] = source;
+        result["double"] = QString::number(sum / kDecimalIterations, 'g', 17);
+        result["exact"] = exact.toString();
+        result["nsPerDouble"] = double(doubleTime) / kDecimalIterations;
+        result["nsPerExact"] = double(exactTime) / kDecimalIterations;
+        result["limbAllocations"] = double(after.allocations - before.allocations) / kDecimalIterations;
+        result["heapAllocations"] = after.heapAllocations - before.heapAllocations;
+        results.append(result);
+    }
+    QTextStream(stdout) << QJsonDocument(results).toJson();
+    return 0;
+}
+
+// Node counts and thread counts the collision solver is timed at. The
+// nodes are scattered at random, densely enough that most overlap another.
+static const int solverBenchmarkCounts[] = { 10000, 50000 };
+static const int solverBenchmarkThreads[] = { 1, 2, 4, 8 };
+static const int kSolverIterations = 20;
+
+// Times the collision solver alone at each thread count, and checks that
+// its pushes match the single threaded ones bit for bit.
+static int runSolverBenchmark() {
+    QJsonArray results;
+    bool ok = true;
+    for (int count : solverBenchmarkCounts) {
+        const qreal side = std::sqrt(qreal(count)) * kNodeRadius * 4 / 3;
+        QRandomGenerator random(1);
+        QList<float> x(count);
+        QList<float> y(count);
+        for (int i = 0; i < count; ++i) {
+            x[i] = float(random.generateDouble() * side);
+            y[i] = float(random.generateDouble() * side);
+        }
+
+        CollisionSolver reference(kNodeRadius);
+        reference.setThreadCount(1);
+        reference.solve(x.constData(), y.constData(), count);
+
+        for (int threads : solverBenchmarkThreads) {
+            CollisionSolver solver(kNodeRadius);
+            solver.setThreadCount(threads);
+            solver.solve(x.constData(), y.constData(), count);
+            const bool same = std::memcmp(solver.dx(), reference.dx(), count * sizeof(float)) == 0
+                    && std::memcmp(solver.dy(), reference.dy(), count * sizeof(float)) == 0;
+            ok &= same;
+
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < kSolverIterations; ++i)
+                solver.solve(x.constData(), y.constData(), count);
+            const qint64 time = timer.nsecsElapsed();
+
+            QJsonObject result;
+            result["nodes"] = count;
+            result["threads"] = threads;
+            result["idealThreads"] = QThread::idealThreadCount();
+            result["nsPerSolve"] = double(time) / kSolverIterations;
+            result["matchesSingleThread"] = same;
+            results.append(result);
+        }
+    }
+    QTextStream(stdout) << QJsonDocument(results).toJson();
+    return ok ? 0 : 1;
+}
+
+// Nodes and steps the node kernels are timed over. Every node starts away
+// from home so all of them are active, and the mouse pushes those nearby.
+static const int kStepBenchmarkNodes = 100000;
+static const int kStepBenchmarkSteps = 50;
+
+// Times NodeStore::step() with each supported implementation and checks
+// that they leave the nodes at the same positions.
+static int runStepBenchmark() {
+    QJsonArray results;
+    QList<float> referenceX;
+    QList<float> referenceY;
+    bool ok = true;
+    for (NodeStore::Implementation implementation : { NodeStore::Scalar, NodeStore::Sse2 }) {
+        if (!NodeStore::isSupported(implementation))
+            continue;
+        NodeStore store;
+        for (int i = 0; i < kStepBenchmarkNodes; ++i)
+            store.add(QPointF(i % 400 * 2 * kNodeRadius, i / 400 * 2 * kNodeRadius));
+        const QList<float> offsetX(kStepBenchmarkNodes, 500);
+        const QList<float> offsetY(kStepBenchmarkNodes, 300);
+        store.displace(offsetX.constData(), offsetY.constData(), kStepBenchmarkNodes);
+        store.takeMoved();
+
+        const QPointF mouse(200 * 2 * kNodeRadius, 125 * 2 * kNodeRadius);
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < kStepBenchmarkSteps; ++i)
+            store.step(mouse, kRepulsionRadius, implementation);
+        const qint64 time = timer.nsecsElapsed();
+
+        const QList<float> x(store.slotX(), store.slotX() + store.size());
+        const QList<float> y(store.slotY(), store.slotY() + store.size());
+        if (referenceX.isEmpty()) {
+            referenceX = x;
+            referenceY = y;
+        }
+        const bool same = x == referenceX && y == referenceY;
+        ok &= same;
+
+        QJsonObject result;
+        result["implementation"] = NodeStore::name(implementation);
+        result["nodes"] = kStepBenchmarkNodes;
+        result["active"] = store.activeCount();
+        result["nsPerStep"] = double(time) / kStepBenchmarkSteps;
+        result["matchesScalar"] = same;
+        results.append(result);
+    }
+    QTextStream(stdout) << QJsonDocument(results).toJson();
+    return ok ? 0 : 1;
+}
+
 int main(int argc, char **argv) {
+    // The benchmark and evaluation runs need no display.
+    bool headless = false;
+    for (int i = 1; i < argc; ++i)
+        headless |= qstrncmp(argv[i], "--bench", 7) == 0 || qstrncmp(argv[i], "--eval", 6) == 0
+                || qstrncmp(argv[i], "--replay", 8) == 0;
+    if (headless && !qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
     QApplication app(argc, argv);
 
-    Scene *scene = new Scene();
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption tokensOption("tokens", "Add <count> nodes below the keypad.", "count", "0");
+    parser.addOption(tokensOption);
+    QCommandLineOption indexOption("index", "Scene index: none (default) or bsp.", "mode", "none");
+    parser.addOption(indexOption);
+    QCommandLineOption statsOption("stats", "Print label memory statistics on exit.");
+    parser.addOption(statsOption);
+    QCommandLineOption benchOption("bench", "Compare the index modes at several node counts and exit.");
+    parser.addOption(benchOption);
+    QCommandLineOption benchDecimalOption("bench-decimal", "Compare double and Decimal arithmetic on keypad sums and exit.");
+    parser.addOption(benchDecimalOption);
+    QCommandLineOption benchSolverOption("bench-solver", "Time the collision solver at several thread counts and exit.");
+    parser.addOption(benchSolverOption);
+    QCommandLineOption benchStepOption("bench-step", "Time the scalar and SSE2 node kernels and exit.");
+    parser.addOption(benchStepOption);
+    QCommandLineOption evalOption("eval", "Evaluate <expression>, timing it over --rows rows, and exit.", "expression");
+    parser.addOption(evalOption);
+    QCommandLineOption rowsOption("rows", "Rows of variable values for --eval.", "count", "1000000");
+    parser.addOption(rowsOption);
+    QCommandLineOption recordOption("record", "Record mouse moves to <file> on exit.", "file");
+    parser.addOption(recordOption);
+    QCommandLineOption replayOption("replay", "Replay the mouse trace in <file> headless, report latencies and "
+                                    "final node positions as JSON, and exit.", "file");
+    parser.addOption(replayOption);
+    parser.process(app);
+
+    if (parser.isSet(benchOption))
+        return runBenchmark();
+    if (parser.isSet(benchDecimalOption))
+        return runDecimalBenchmark();
+    if (parser.isSet(benchSolverOption))
+        return runSolverBenchmark();
+    if (parser.isSet(benchStepOption))
+        return runStepBenchmark();
+    if (parser.isSet(evalOption))
+        return runEvaluation(parser.value(evalOption), qMax(1, parser.value(rowsOption).toInt()));
+
+    const QString index = parser.value(indexOption);
+    if (index != QLatin1String("none") && index != QLatin1String("bsp")) {
+        qWarning("Unknown index mode %s", qPrintable(index));
+        return 1;
+    }
+    const Scene::IndexMode mode = index == QLatin1String("bsp") ? Scene::BspIndex : Scene::DynamicIndex;
+    if (parser.isSet(replayOption))
+        return runReplay(parser.value(replayOption), mode);
+
+    Scene *scene = new Scene(mode);
+    scene->addTokens(parser.value(tokensOption).toInt());
     View *view = new View(scene);
+    MouseTrace trace;
+    if (parser.isSet(recordOption)) {
+        trace.setTokens(parser.value(tokensOption).toInt());
+        view->record(&trace);
+    }
     view->setWindowTitle("Calculator Nodes");
     view->resize(600, 800);
 
@@ -134,5 +815,21 @@ int main(int argc, char **argv) {
 #endif
     view->show();
 
-    return app.exec();
+    const int result = app.exec();
+    if (parser.isSet(recordOption)) {
+        trace.setViewport(view->mapToScene(view->viewport()->rect()).boundingRect(), view->viewport()->size());
+        if (!trace.save(parser.value(recordOption))) {
+            qWarning("%s", qPrintable(trace.errorString()));
+            return 1;
+        }
+    }
+    if (parser.isSet(statsOption)) {
+        const NodeBatchItem::LabelStatistics stats = scene->labelStatistics();
+        const qreal perNode = stats.nodes ? qreal(stats.bytes) / stats.nodes : 0;
+        const qreal saved = stats.nodes ? qreal(stats.unsharedBytes - stats.bytes) / stats.nodes : 0;
+        qInfo("labels: %d nodes share %d pixmaps of %lld bytes, %.1f bytes per node, "
+              "%.1f saved per node over a pixmap each",
+              stats.nodes, stats.labels, stats.bytes, perNode, saved);
+    }
+    return result;
 }
\ No newline at end of file
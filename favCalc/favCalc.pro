@@ -1,3 +1,6 @@
 QT += widgets
 
-SOURCES = favCalc.cpp
\ No newline at end of file
+SOURCES = favCalc.cpp collisionsolver.cpp decimal.cpp expression.cpp labelcache.cpp mousetrace.cpp nodebatchitem.cpp \
+    nodestore.cpp simulationloop.cpp spatialgrid.cpp
+HEADERS = collisionsolver.h decimal.h expression.h labelcache.h mousetrace.h nodebatchitem.h nodestore.h \
+    simulationloop.h spatialgrid.h
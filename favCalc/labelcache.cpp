@@ -0,0 +1,48 @@
+// labelcache.cpp
+
+#include "labelcache.h"
+
+QSharedPointer<LabelCache> LabelCache::get(const QFont &font, qreal scale) {
+    static QHash<QPair<QString, qreal>, QWeakPointer<LabelCache>> caches;
+
+    const QPair<QString, qreal> key(font.key(), scale);
+    if (QSharedPointer<LabelCache> cache = caches.value(key).toStrongRef())
+        return cache;
+
+    caches.removeIf([](const auto &entry) { return entry.value().isNull(); });
+    QSharedPointer<LabelCache> cache(new LabelCache(font, scale));
+    caches.insert(key, cache);
+    return cache;
+}
+
+LabelCache::LabelCache(const QFont &font, qreal scale)
+    : m_font(font), m_scale(scale) {
+}
+
+qint64 LabelCache::byteCount(const QPixmap &pixmap) {
+    return qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+}
+
+QPixmap LabelCache::pixmap(const QString &text) {
+    const auto it = m_pixmaps.constFind(text);
+    if (it != m_pixmaps.cend())
+        return *it;
+
+    // A pixel of slack on both sides for antialiasing.
+    const QFontMetricsF metrics(m_font);
+    const QSizeF size(metrics.horizontalAdvance(text) + 2, metrics.height());
+    QPixmap pixmap((size * m_scale).toSize().expandedTo(QSize(1, 1)));
+    pixmap.setDevicePixelRatio(m_scale);
+    pixmap.fill(Qt::transparent);
+
+    QPainter painter(&pixmap);
+    painter.setRenderHint(QPainter::TextAntialiasing);
+    painter.setFont(m_font);
+    painter.setPen(Qt::black);
+    painter.drawText(QRectF(QPointF(0, 0), size), Qt::AlignCenter, text);
+    painter.end();
+
+    m_byteCount += byteCount(pixmap);
+    m_pixmaps.insert(text, pixmap);
+    return pixmap;
+}
@@ -0,0 +1,37 @@
+// labelcache.h
+
+#ifndef LABELCACHE_H
+#define LABELCACHE_H
+
+#include <QtGui>
+
+// Node labels rendered into pixmaps, each distinct text once, for one font
+// and device scale (device pixels per logical pixel, view zoom included).
+// Instances are shared by everything drawing labels in the same font at
+// the same scale and released when the last user moves on, so a window
+// changing screens or zoom does not keep the old renderings around.
+class LabelCache {
+public:
+    static QSharedPointer<LabelCache> get(const QFont &font, qreal scale);
+
+    QFont font() const { return m_font; }
+    qreal scale() const { return m_scale; }
+
+    // The text centered in a pixmap with the cache's device pixel ratio,
+    // rendered on first use.
+    QPixmap pixmap(const QString &text);
+
+    int count() const { return m_pixmaps.size(); }
+    qint64 byteCount() const { return m_byteCount; }
+    static qint64 byteCount(const QPixmap &pixmap);
+
+private:
+    LabelCache(const QFont &font, qreal scale);
+
+    QFont m_font;
+    qreal m_scale;
+    QHash<QString, QPixmap> m_pixmaps;
+    qint64 m_byteCount = 0;
+};
+
+#endif // LABELCACHE_H
@@ -0,0 +1,182 @@
+// mousetrace.cpp
+
+#include "mousetrace.h"
+
+static const char kMagic[] = "FCMT";
+static const quint8 kVersion = 1;
+// Positions are stored in these fractions of a unit.
+static const int kSubunits = 16;
+
+namespace {
+
+qint64 toSubunits(qreal value) {
+    return qRound64(value * kSubunits);
+}
+
+qreal quantized(qreal value) {
+    return qreal(toSubunits(value)) / kSubunits;
+}
+
+void writeNumber(QByteArray &out, quint64 value) {
+    while (value >= 0x80) {
+        out.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+// Zigzag, so small negative numbers stay short too.
+void writeSigned(QByteArray &out, qint64 value) {
+    writeNumber(out, (quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+class Reader {
+public:
+    explicit Reader(const QByteArray &data) : m_data(data) {}
+
+    bool atEnd() const { return m_pos == m_data.size(); }
+    bool failed() const { return m_failed; }
+
+    QByteArray bytes(int count) {
+        if (m_data.size() - m_pos < count) {
+            m_failed = true;
+            return QByteArray();
+        }
+        m_pos += count;
+        return m_data.mid(m_pos - count, count);
+    }
+
+    quint64 number() {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (m_pos == m_data.size())
+                break;
+            const quint8 byte = quint8(m_data.at(m_pos++));
+            value |= quint64(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        m_failed = true;
+        return 0;
+    }
+
+    qint64 signedNumber() {
+        const quint64 value = number();
+        return qint64(value >> 1) ^ -qint64(value & 1);
+    }
+
+private:
+    const QByteArray &m_data;
+    int m_pos = 0;
+    bool m_failed = false;
+};
+
+} // namespace
+
+void MouseTrace::setViewport(const QRectF &sceneRect, const QSize &size) {
+    m_viewportRect = QRectF(quantized(sceneRect.x()), quantized(sceneRect.y()),
+                            quantized(sceneRect.width()), quantized(sceneRect.height()));
+    m_viewportSize = size;
+}
+
+qint64 MouseTrace::eventTime(qint64 nsecs) {
+    if (m_start < 0)
+        m_start = nsecs;
+    return qMax(m_events.isEmpty() ? 0 : m_events.last().time, (nsecs - m_start) / 1000);
+}
+
+void MouseTrace::addMove(qint64 nsecs, const QPointF &pos) {
+    m_events.append({ eventTime(nsecs), QPointF(quantized(pos.x()), quantized(pos.y())), false });
+}
+
+void MouseTrace::addLeave(qint64 nsecs) {
+    m_events.append({ eventTime(nsecs), QPointF(), true });
+}
+
+bool MouseTrace::save(const QString &fileName) {
+    QByteArray data(kMagic, 4);
+    data.append(char(kVersion));
+    writeNumber(data, quint64(qMax(0, m_tokens)));
+    writeSigned(data, toSubunits(m_viewportRect.x()));
+    writeSigned(data, toSubunits(m_viewportRect.y()));
+    writeSigned(data, toSubunits(m_viewportRect.width()));
+    writeSigned(data, toSubunits(m_viewportRect.height()));
+    writeNumber(data, quint64(qMax(0, m_viewportSize.width())));
+    writeNumber(data, quint64(qMax(0, m_viewportSize.height())));
+
+    writeNumber(data, quint64(m_events.size()));
+    qint64 time = 0;
+    qint64 x = 0;
+    qint64 y = 0;
+    for (const Event &event : std::as_const(m_events)) {
+        writeNumber(data, (quint64(event.time - time) << 1) | quint64(event.leave));
+        time = event.time;
+        if (event.leave)
+            continue;
+        writeSigned(data, toSubunits(event.pos.x()) - x);
+        writeSigned(data, toSubunits(event.pos.y()) - y);
+        x = toSubunits(event.pos.x());
+        y = toSubunits(event.pos.y());
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        m_errorString = file.errorString();
+        return false;
+    }
+    m_errorString.clear();
+    return true;
+}
+
+bool MouseTrace::load(const QString &fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_errorString = file.errorString();
+        return false;
+    }
+    const QByteArray data = file.readAll();
+
+    Reader reader(data);
+    if (reader.bytes(4) != QByteArray(kMagic, 4) || reader.bytes(1) != QByteArray(1, char(kVersion))) {
+        m_errorString = QStringLiteral("%1 is not a mouse trace").arg(fileName);
+        return false;
+    }
+    const int tokens = int(reader.number());
+    const qint64 left = reader.signedNumber();
+    const qint64 top = reader.signedNumber();
+    const qint64 width = reader.signedNumber();
+    const qint64 height = reader.signedNumber();
+    const int viewportWidth = int(reader.number());
+    const int viewportHeight = int(reader.number());
+
+    const quint64 count = reader.number();
+    QList<Event> events;
+    qint64 time = 0;
+    qint64 x = 0;
+    qint64 y = 0;
+    // Every event takes at least a byte, so a corrupt count stops early.
+    for (quint64 i = 0; i < count && !reader.failed() && !reader.atEnd(); ++i) {
+        const quint64 head = reader.number();
+        time += qint64(head >> 1);
+        if (head & 1) {
+            events.append({ time, QPointF(), true });
+            continue;
+        }
+        x += reader.signedNumber();
+        y += reader.signedNumber();
+        events.append({ time, QPointF(qreal(x) / kSubunits, qreal(y) / kSubunits), false });
+    }
+    if (reader.failed() || quint64(events.size()) != count || !reader.atEnd()) {
+        m_errorString = QStringLiteral("%1 is truncated or corrupt").arg(fileName);
+        return false;
+    }
+
+    m_tokens = tokens;
+    m_viewportRect = QRectF(qreal(left) / kSubunits, qreal(top) / kSubunits,
+                            qreal(width) / kSubunits, qreal(height) / kSubunits);
+    m_viewportSize = QSize(viewportWidth, viewportHeight);
+    m_events = events;
+    m_start = -1;
+    m_errorString.clear();
+    return true;
+}
@@ -0,0 +1,53 @@
+// mousetrace.h
+
+#ifndef MOUSETRACE_H
+#define MOUSETRACE_H
+
+#include <QtCore>
+
+// Mouse positions over time, in scene coordinates, recorded from a view so
+// the same input can be fed to a scene again. Times are kept to the
+// microsecond and positions to a sixteenth of a unit, as the file holds
+// them, so a loaded trace equals the one saved.
+//
+// The file is a short header followed by the events, each a variable
+// length time delta with a flag for leaving the view and, for moves, the
+// position's delta from the previous move: a few bytes per event.
+class MouseTrace {
+public:
+    struct Event {
+        qint64 time; // microseconds since the first event
+        QPointF pos;
+        bool leave;
+    };
+
+    // The scene the trace was recorded on: nodes added below the keypad,
+    // and the part of the scene the view showed.
+    void setTokens(int tokens) { m_tokens = tokens; }
+    int tokens() const { return m_tokens; }
+    void setViewport(const QRectF &sceneRect, const QSize &size);
+    QRectF viewportRect() const { return m_viewportRect; }
+    QSize viewportSize() const { return m_viewportSize; }
+
+    // 'nsecs' from any clock; the first event is time zero.
+    void addMove(qint64 nsecs, const QPointF &pos);
+    void addLeave(qint64 nsecs);
+
+    const QList<Event> &events() const { return m_events; }
+
+    bool save(const QString &fileName);
+    bool load(const QString &fileName);
+    QString errorString() const { return m_errorString; }
+
+private:
+    qint64 eventTime(qint64 nsecs);
+
+    int m_tokens = 0;
+    QRectF m_viewportRect;
+    QSize m_viewportSize;
+    QList<Event> m_events;
+    qint64 m_start = -1;
+    QString m_errorString;
+};
+
+#endif // MOUSETRACE_H
@@ -0,0 +1,146 @@
+// nodebatchitem.cpp
+
+#include "nodebatchitem.h"
+#include "labelcache.h"
+#include "nodestore.h"
+
+// Width of the circle's outline, centered on its radius.
+static const qreal kOutline = 1.0;
+
+NodeBatchItem::NodeBatchItem(const NodeStore *store, qreal radius, QGraphicsItem *parent)
+    : QGraphicsItem(parent), m_store(store), m_radius(radius) {
+    setFlag(ItemUsesExtendedStyleOption);
+}
+
+void NodeBatchItem::setLabel(int id, const QString &label) {
+    if (id >= m_labels.size())
+        m_labels.resize(id + 1, -1);
+
+    int index = m_labelIndex.value(label, -1);
+    if (index < 0) {
+        index = m_labelTexts.size();
+        m_labelTexts.append(label);
+        m_labelIndex.insert(label, index);
+        m_labelPixmaps.append(QPixmap());
+    }
+    m_labels[id] = index;
+}
+
+QRectF NodeBatchItem::nodeRect(const QPointF &pos) const {
+    const qreal half = m_radius + kOutline;
+    return QRectF(pos.x() - half, pos.y() - half, 2 * half, 2 * half);
+}
+
+void NodeBatchItem::updateNodes(const QList<int> &moved) {
+    QRectF damage;
+    const int shown = m_positions.size();
+    for (int id = shown; id < m_store->size(); ++id) {
+        m_positions.append(m_store->pos(id));
+        damage |= nodeRect(m_positions.last());
+    }
+    for (int id : moved) {
+        if (id >= shown)
+            continue;
+        damage |= nodeRect(m_positions.at(id));
+        m_positions[id] = m_store->pos(id);
+        damage |= nodeRect(m_positions.at(id));
+    }
+    if (damage.isEmpty())
+        return;
+
+    updateBounds();
+    update(damage);
+}
+
+// A pass over all positions, but a cheap one next to painting them.
+void NodeBatchItem::updateBounds() {
+    QRectF bounds;
+    if (!m_positions.isEmpty()) {
+        qreal left = m_positions.first().x();
+        qreal right = left;
+        qreal top = m_positions.first().y();
+        qreal bottom = top;
+        for (const QPointF &pos : std::as_const(m_positions)) {
+            left = qMin(left, pos.x());
+            right = qMax(right, pos.x());
+            top = qMin(top, pos.y());
+            bottom = qMax(bottom, pos.y());
+        }
+        const qreal half = m_radius + kOutline;
+        bounds = QRectF(QPointF(left - half, top - half), QPointF(right + half, bottom + half));
+    }
+    if (bounds != m_bounds) {
+        prepareGeometryChange();
+        m_bounds = bounds;
+    }
+}
+
+QRectF NodeBatchItem::boundingRect() const {
+    return m_bounds;
+}
+
+NodeBatchItem::LabelStatistics NodeBatchItem::labelStatistics() const {
+    LabelStatistics stats;
+    for (const QPixmap &pixmap : m_labelPixmaps) {
+        if (!pixmap.isNull()) {
+            ++stats.labels;
+            stats.bytes += LabelCache::byteCount(pixmap);
+        }
+    }
+    for (int label : m_labels) {
+        if (label >= 0 && !m_labelPixmaps.at(label).isNull()) {
+            ++stats.nodes;
+            stats.unsharedBytes += LabelCache::byteCount(m_labelPixmaps.at(label));
+        }
+    }
+    return stats;
+}
+
+// The cache is only asked once per label and scale; drawing a node is then
+// a list lookup.
+const QPixmap &NodeBatchItem::labelPixmap(int label) {
+    QPixmap &pixmap = m_labelPixmaps[label];
+    if (pixmap.isNull())
+        pixmap = m_labelCache->pixmap(m_labelTexts.at(label));
+    return pixmap;
+}
+
+void NodeBatchItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *) {
+    // Pixmaps match the device pixels as long as the view only translates.
+    const qreal scale = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform())
+            * painter->device()->devicePixelRatioF();
+    if (!qFuzzyCompare(scale, m_pixmapScale)) {
+        m_pixmapScale = scale;
+        m_circle = QPixmap();
+        m_labelCache = LabelCache::get(QFont("Arial", 14, QFont::Bold), scale);
+        for (QPixmap &pixmap : m_labelPixmaps)
+            pixmap = QPixmap();
+    }
+
+    const qreal half = m_radius + kOutline;
+    if (m_circle.isNull()) {
+        const int size = qCeil(2 * half * scale);
+        m_circle = QPixmap(size, size);
+        m_circle.setDevicePixelRatio(scale);
+        m_circle.fill(Qt::transparent);
+        QPainter circlePainter(&m_circle);
+        circlePainter.setRenderHint(QPainter::Antialiasing);
+        circlePainter.setPen(QPen(Qt::black, kOutline));
+        circlePainter.setBrush(Qt::lightGray);
+        circlePainter.drawEllipse(QPointF(half, half), m_radius, m_radius);
+    }
+
+    const QRectF exposed = option->exposedRect;
+    for (int id = 0; id < m_positions.size(); ++id) {
+        const QPointF &pos = m_positions.at(id);
+        if (!exposed.intersects(nodeRect(pos)))
+            continue;
+        painter->drawPixmap(pos - QPointF(half, half), m_circle);
+
+        const int label = id < m_labels.size() ? m_labels.at(id) : -1;
+        if (label < 0)
+            continue;
+        const QPixmap &text = labelPixmap(label);
+        painter->drawPixmap(pos - QPointF(text.width(), text.height()) / (2 * scale), text);
+    }
+}
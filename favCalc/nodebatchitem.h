@@ -0,0 +1,60 @@
+// nodebatchitem.h
+
+#ifndef NODEBATCHITEM_H
+#define NODEBATCHITEM_H
+
+#include <QtWidgets>
+
+class LabelCache;
+class NodeStore;
+
+// Draws every node of a NodeStore as one graphics item: a circle with a
+// label, both blitted from pixmaps rendered once per device scale, the
+// labels shared through a LabelCache. The scene sees a single item with one
+// bounding rect, so moving nodes costs no per-node index updates or paint
+// calls.
+class NodeBatchItem : public QGraphicsItem {
+public:
+    NodeBatchItem(const NodeStore *store, qreal radius, QGraphicsItem *parent = nullptr);
+
+    // Labels are set per node id, before the node is first shown.
+    void setLabel(int id, const QString &label);
+
+    // Catches up with the store: the nodes listed moved, and any added
+    // since the last call appear.
+    void updateNodes(const QList<int> &moved);
+
+    // Label memory at the current scale, for the nodes drawn so far. Each
+    // distinct label has one pixmap however many nodes show it; without
+    // sharing, every node would hold its own.
+    struct LabelStatistics {
+        int nodes = 0;
+        int labels = 0;
+        qint64 bytes = 0;
+        qint64 unsharedBytes = 0;
+    };
+    LabelStatistics labelStatistics() const;
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+private:
+    QRectF nodeRect(const QPointF &pos) const;
+    void updateBounds();
+    const QPixmap &labelPixmap(int label);
+
+    const NodeStore *m_store;
+    qreal m_radius;
+    QList<QPointF> m_positions; // as last shown
+    QList<int> m_labels;        // index into m_labelTexts per node
+    QStringList m_labelTexts;
+    QHash<QString, int> m_labelIndex;
+    QRectF m_bounds;
+
+    qreal m_pixmapScale = 0;
+    QPixmap m_circle;
+    QSharedPointer<LabelCache> m_labelCache;
+    QList<QPixmap> m_labelPixmaps; // from m_labelCache, by label index
+};
+
+#endif // NODEBATCHITEM_H
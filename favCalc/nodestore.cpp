@@ -0,0 +1,266 @@
+// nodestore.cpp
+
+#include "nodestore.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#  define NODESTORE_X86
+#  include <immintrin.h>
+#endif
+
+// Mouse closer to a node's center than this (squared) leaves it alone.
+static const float kMinDistance2 = 0.1f;
+// Fraction of the overlap with the mouse a node moves away per step.
+static const float kRepelFactor = 0.3f;
+// Fraction of the way home a node glides per step.
+static const float kGlideFactor = 0.1f;
+// A node gliding home this close to it is put back exactly.
+static const float kSettleDistance = 0.05f;
+
+namespace {
+
+struct Kernel {
+    float *x;
+    float *y;
+    const float *homeX;
+    const float *homeY;
+    int count;
+    float mouseX;
+    float mouseY;
+    float radius;
+};
+
+// The vector version does the same operations in the same order, so the
+// results are identical. Returns the largest distance a node moved along
+// either axis.
+float stepScalar(const Kernel &k, int begin) {
+    const float radius2 = k.radius * k.radius;
+    float moved = 0;
+    for (int i = begin; i < k.count; ++i) {
+        const float x = k.x[i];
+        const float y = k.y[i];
+        const float dx = x - k.mouseX;
+        const float dy = y - k.mouseY;
+        const float dist2 = dx * dx + dy * dy;
+        const float backX = k.homeX[i] - x;
+        const float backY = k.homeY[i] - y;
+
+        if (dist2 < radius2 && dist2 > kMinDistance2) {
+            const float dist = std::sqrt(dist2);
+            const float push = (k.radius - dist) / dist * kRepelFactor;
+            k.x[i] = x + dx * push;
+            k.y[i] = y + dy * push;
+        } else if (std::fabs(backX) < kSettleDistance && std::fabs(backY) < kSettleDistance) {
+            k.x[i] = k.homeX[i];
+            k.y[i] = k.homeY[i];
+        } else {
+            k.x[i] = x + backX * kGlideFactor;
+            k.y[i] = y + backY * kGlideFactor;
+        }
+        moved = std::max(moved, std::max(std::fabs(k.x[i] - x), std::fabs(k.y[i] - y)));
+    }
+    return moved;
+}
+
+#ifdef NODESTORE_X86
+
+__attribute__((target("sse2")))
+inline __m128 selectSse2(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+__attribute__((target("sse2")))
+float stepSse2(const Kernel &k) {
+    const __m128 mouseX = _mm_set1_ps(k.mouseX);
+    const __m128 mouseY = _mm_set1_ps(k.mouseY);
+    const __m128 radius = _mm_set1_ps(k.radius);
+    const __m128 radius2 = _mm_set1_ps(k.radius * k.radius);
+    const __m128 minDistance2 = _mm_set1_ps(kMinDistance2);
+    const __m128 repelFactor = _mm_set1_ps(kRepelFactor);
+    const __m128 glideFactor = _mm_set1_ps(kGlideFactor);
+    const __m128 settleDistance = _mm_set1_ps(kSettleDistance);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    __m128 moved = _mm_setzero_ps();
+
+    int i = 0;
+    for (; i + 4 <= k.count; i += 4) {
+        const __m128 x = _mm_loadu_ps(k.x + i);
+        const __m128 y = _mm_loadu_ps(k.y + i);
+        const __m128 homeX = _mm_loadu_ps(k.homeX + i);
+        const __m128 homeY = _mm_loadu_ps(k.homeY + i);
+        const __m128 dx = _mm_sub_ps(x, mouseX);
+        const __m128 dy = _mm_sub_ps(y, mouseY);
+        const __m128 dist2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        const __m128 backX = _mm_sub_ps(homeX, x);
+        const __m128 backY = _mm_sub_ps(homeY, y);
+
+        // Lanes that are not pushed may divide by zero here; they are
+        // discarded.
+        const __m128 repel = _mm_and_ps(_mm_cmplt_ps(dist2, radius2), _mm_cmpgt_ps(dist2, minDistance2));
+        const __m128 dist = _mm_sqrt_ps(dist2);
+        const __m128 push = _mm_mul_ps(_mm_div_ps(_mm_sub_ps(radius, dist), dist), repelFactor);
+        const __m128 settled = _mm_and_ps(_mm_cmplt_ps(_mm_andnot_ps(signBit, backX), settleDistance),
+                                          _mm_cmplt_ps(_mm_andnot_ps(signBit, backY), settleDistance));
+
+        const __m128 glideX = selectSse2(settled, homeX, _mm_add_ps(x, _mm_mul_ps(backX, glideFactor)));
+        const __m128 glideY = selectSse2(settled, homeY, _mm_add_ps(y, _mm_mul_ps(backY, glideFactor)));
+        const __m128 newX = selectSse2(repel, _mm_add_ps(x, _mm_mul_ps(dx, push)), glideX);
+        const __m128 newY = selectSse2(repel, _mm_add_ps(y, _mm_mul_ps(dy, push)), glideY);
+        _mm_storeu_ps(k.x + i, newX);
+        _mm_storeu_ps(k.y + i, newY);
+        moved = _mm_max_ps(moved, _mm_max_ps(_mm_andnot_ps(signBit, _mm_sub_ps(newX, x)),
+                                             _mm_andnot_ps(signBit, _mm_sub_ps(newY, y))));
+    }
+
+    moved = _mm_max_ps(moved, _mm_movehl_ps(moved, moved));
+    moved = _mm_max_ss(moved, _mm_shuffle_ps(moved, moved, 1));
+    return std::max(_mm_cvtss_f32(moved), stepScalar(k, i));
+}
+
+#endif // NODESTORE_X86
+
+} // namespace
+
+bool NodeStore::isSupported(Implementation implementation) {
+    switch (implementation) {
+    case Scalar:
+        return true;
+#ifdef NODESTORE_X86
+    case Sse2:
+        return __builtin_cpu_supports("sse2");
+#else
+    case Sse2:
+        break;
+#endif
+    }
+    return false;
+}
+
+NodeStore::Implementation NodeStore::bestImplementation() {
+    static const Implementation best = isSupported(Sse2) ? Sse2 : Scalar;
+    return best;
+}
+
+const char *NodeStore::name(Implementation implementation) {
+    switch (implementation) {
+    case Scalar:
+        return "scalar";
+    case Sse2:
+        return "sse2";
+    }
+    return "";
+}
+
+int NodeStore::add(const QPointF &home) {
+    const int id = m_ids.size();
+    m_x.append(home.x());
+    m_y.append(home.y());
+    m_homeX.append(home.x());
+    m_homeY.append(home.y());
+    m_ids.append(id);
+    m_slots.append(id);
+    m_isMoved.append(false);
+    return id;
+}
+
+void NodeStore::clear() {
+    m_x.clear();
+    m_y.clear();
+    m_homeX.clear();
+    m_homeY.clear();
+    m_ids.clear();
+    m_slots.clear();
+    m_activeCount = 0;
+    m_moved.clear();
+    m_isMoved.clear();
+}
+
+void NodeStore::activate(int id) {
+    const int slot = m_slots.at(id);
+    if (slot >= m_activeCount)
+        swapSlots(slot, m_activeCount++);
+}
+
+qreal NodeStore::step(const QPointF &mouse, qreal radius, Implementation implementation) {
+    if (m_activeCount == 0)
+        return 0;
+
+    Kernel kernel;
+    kernel.x = m_x.data();
+    kernel.y = m_y.data();
+    kernel.homeX = m_homeX.constData();
+    kernel.homeY = m_homeY.constData();
+    kernel.count = m_activeCount;
+    kernel.mouseX = mouse.x();
+    kernel.mouseY = mouse.y();
+    kernel.radius = radius;
+
+    float moved;
+    if (!isSupported(implementation))
+        implementation = Scalar;
+    switch (implementation) {
+#ifdef NODESTORE_X86
+    case Sse2:
+        moved = stepSse2(kernel);
+        break;
+#endif
+    default:
+        moved = stepScalar(kernel, 0);
+        break;
+    }
+
+    // Settled nodes swap places with the last active one, which has already
+    // been looked at.
+    for (int slot = m_activeCount - 1; slot >= 0; --slot) {
+        markMoved(m_ids.at(slot));
+        if (m_x.at(slot) == m_homeX.at(slot) && m_y.at(slot) == m_homeY.at(slot))
+            swapSlots(slot, --m_activeCount);
+    }
+    return moved;
+}
+
+qreal NodeStore::displace(const float *dx, const float *dy, int count) {
+    // Activating reorders the slots, so only once all have moved.
+    float moved = 0;
+    for (int slot = 0; slot < count; ++slot) {
+        if (dx[slot] == 0 && dy[slot] == 0)
+            continue;
+        m_x[slot] += dx[slot];
+        m_y[slot] += dy[slot];
+        moved = std::max(moved, std::max(std::fabs(dx[slot]), std::fabs(dy[slot])));
+        m_displaced.append(m_ids.at(slot));
+    }
+    for (int id : std::as_const(m_displaced)) {
+        activate(id);
+        markMoved(id);
+    }
+    m_displaced.clear();
+    return moved;
+}
+
+QList<int> NodeStore::takeMoved() {
+    for (int id : std::as_const(m_moved))
+        m_isMoved[id] = false;
+    return std::exchange(m_moved, QList<int>());
+}
+
+void NodeStore::markMoved(int id) {
+    if (!m_isMoved.at(id)) {
+        m_isMoved[id] = true;
+        m_moved.append(id);
+    }
+}
+
+void NodeStore::swapSlots(int a, int b) {
+    if (a == b)
+        return;
+    std::swap(m_x[a], m_x[b]);
+    std::swap(m_y[a], m_y[b]);
+    std::swap(m_homeX[a], m_homeX[b]);
+    std::swap(m_homeY[a], m_homeY[b]);
+    std::swap(m_ids[a], m_ids[b]);
+    m_slots[m_ids.at(a)] = a;
+    m_slots[m_ids.at(b)] = b;
+}
@@ -0,0 +1,68 @@
+// nodestore.h
+
+#ifndef NODESTORE_H
+#define NODESTORE_H
+
+#include <QtCore>
+
+// Simulation state of the nodes as structure of arrays, stepped by a
+// vectorized kernel, with an SSE2 version picked at runtime on x86 builds
+// with GCC or Clang. Both implementations move the nodes the same.
+//
+// Nodes are numbered by the order they are added. Only active nodes, the
+// ones away from home or about to be pushed, are stepped; they are kept in
+// the first activeCount() slots of the arrays so the kernel runs over one
+// contiguous range, and a node that settles back home leaves it.
+class NodeStore {
+public:
+    enum Implementation { Scalar, Sse2 };
+
+    static Implementation bestImplementation();
+    static bool isSupported(Implementation implementation);
+    static const char *name(Implementation implementation);
+
+    int size() const { return m_ids.size(); }
+    int add(const QPointF &home);
+    void clear();
+
+    QPointF pos(int id) const { return QPointF(m_x.at(m_slots.at(id)), m_y.at(m_slots.at(id))); }
+    QPointF home(int id) const { return QPointF(m_homeX.at(m_slots.at(id)), m_homeY.at(m_slots.at(id))); }
+
+    int activeCount() const { return m_activeCount; }
+    bool isActive(int id) const { return m_slots.at(id) < m_activeCount; }
+    void activate(int id);
+
+    // Moves every active node: pushed away from 'mouse' if closer than
+    // 'radius', otherwise a step on the glide home, where it settles.
+    // Returns the largest distance a node moved along either axis.
+    qreal step(const QPointF &mouse, qreal radius, Implementation implementation = bestImplementation());
+
+    // Positions in slot order, for passes over all nodes.
+    const float *slotX() const { return m_x.constData(); }
+    const float *slotY() const { return m_y.constData(); }
+
+    // Moves the node in each of the first 'count' slots by (dx, dy) in
+    // slot order. Nodes that move become active. Returns the largest
+    // distance a node moved along either axis.
+    qreal displace(const float *dx, const float *dy, int count);
+
+    // Nodes that moved since the last call, for updating what shows them.
+    QList<int> takeMoved();
+
+private:
+    void swapSlots(int a, int b);
+    void markMoved(int id);
+
+    QList<float> m_x;
+    QList<float> m_y;
+    QList<float> m_homeX;
+    QList<float> m_homeY;
+    QList<int> m_ids;   // node in each slot
+    QList<int> m_slots; // slot of each node
+    int m_activeCount = 0;
+    QList<int> m_moved;
+    QList<bool> m_isMoved;
+    QList<int> m_displaced;
+};
+
+#endif // NODESTORE_H
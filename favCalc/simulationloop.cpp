@@ -0,0 +1,59 @@
+// simulationloop.cpp
+
+#include "simulationloop.h"
+
+// After a stall, at most this many steps are caught up at once; the rest
+// of the time is dropped rather than making the next tick longer still.
+static const int kMaxStepsPerTick = 8;
+
+SimulationLoop::SimulationLoop(int stepsPerSecond)
+    : m_stepInterval(1000000000LL / qMax(1, stepsPerSecond)) {
+    m_timer.setTimerType(Qt::PreciseTimer);
+    m_timer.setInterval(int(qMax<qint64>(1, m_stepInterval / 1000000)));
+    QObject::connect(&m_timer, &QTimer::timeout, [this] { tick(); });
+    m_clock.start();
+}
+
+void SimulationLoop::setManualClock(const std::function<qint64()> &clock) {
+    m_manualClock = clock;
+    m_timer.stop();
+}
+
+void SimulationLoop::wake() {
+    if (m_awake)
+        return;
+    // Time spent asleep is not simulated; the first step runs right away.
+    m_awake = true;
+    m_lastTick = now();
+    m_accumulated = m_stepInterval;
+    if (!m_manualClock)
+        m_timer.start();
+    tick();
+}
+
+int SimulationLoop::tick() {
+    const qint64 time = now();
+    m_accumulated += time - m_lastTick;
+    m_lastTick = time;
+
+    bool moving = true;
+    int steps = 0;
+    while (m_accumulated >= m_stepInterval && steps < kMaxStepsPerTick) {
+        m_accumulated -= m_stepInterval;
+        ++m_stepCount;
+        ++steps;
+        moving = m_step ? m_step() : false;
+        if (!moving)
+            break;
+    }
+    if (steps == kMaxStepsPerTick)
+        m_accumulated %= m_stepInterval;
+
+    if (steps > 0 && m_frame)
+        m_frame();
+    if (!moving) {
+        m_awake = false;
+        m_timer.stop();
+    }
+    return steps;
+}
@@ -0,0 +1,58 @@
+// simulationloop.h
+
+#ifndef SIMULATIONLOOP_H
+#define SIMULATIONLOOP_H
+
+#include <QtCore>
+#include <functional>
+
+// Runs a simulation at a fixed number of steps per second, however often
+// input arrives. Elapsed time accumulates and is spent in whole steps on
+// each tick of a timer, so the motion per second is the same whatever the
+// timer and input rates; input only updates state the next step reads.
+//
+// The step function returns whether the simulation is still moving. Once
+// a step says it is not, the loop stops its timer until wake() is called,
+// which is what input handlers do after updating the state.
+class SimulationLoop {
+public:
+    using StepFunction = std::function<bool()>;
+    using FrameFunction = std::function<void()>;
+
+    explicit SimulationLoop(int stepsPerSecond);
+
+    void setStepFunction(const StepFunction &step) { m_step = step; }
+    // Called after the steps of each tick, to show the new state.
+    void setFrameFunction(const FrameFunction &frame) { m_frame = frame; }
+
+    qint64 stepInterval() const { return m_stepInterval; }
+    qint64 tickInterval() const { return qint64(m_timer.interval()) * 1000000; }
+    qint64 stepCount() const { return m_stepCount; }
+    bool isSleeping() const { return !m_awake; }
+
+    void wake();
+
+    // Replays run the loop on their own clock, in nanoseconds: no timer
+    // runs, and the caller calls tick() each tickInterval() while the loop
+    // is awake.
+    void setManualClock(const std::function<qint64()> &clock);
+
+    // Runs the steps due and returns how many ran; a frame follows if any.
+    int tick();
+
+private:
+    qint64 now() const { return m_manualClock ? m_manualClock() : m_clock.nsecsElapsed(); }
+
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    std::function<qint64()> m_manualClock;
+    StepFunction m_step;
+    FrameFunction m_frame;
+    qint64 m_stepInterval;
+    qint64 m_lastTick = 0;
+    qint64 m_accumulated = 0;
+    qint64 m_stepCount = 0;
+    bool m_awake = false;
+};
+
+#endif // SIMULATIONLOOP_H
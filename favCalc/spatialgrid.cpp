@@ -0,0 +1,51 @@
+// spatialgrid.cpp
+
+#include "spatialgrid.h"
+
+SpatialGrid::SpatialGrid(qreal cellSize)
+    : m_cellSize(qMax<qreal>(1, cellSize)) {
+}
+
+void SpatialGrid::insert(int id, const QPointF &pos) {
+    if (id >= m_entries.size())
+        m_entries.resize(id + 1);
+    else if (m_entries.at(id).slot >= 0)
+        unlink(id);
+
+    Entry &entry = m_entries[id];
+    QList<int> &cell = m_cells[cellOf(pos)];
+    entry.cell = cellOf(pos);
+    entry.slot = cell.size();
+    cell.append(id);
+}
+
+void SpatialGrid::remove(int id) {
+    if (id < m_entries.size() && m_entries.at(id).slot >= 0)
+        unlink(id);
+}
+
+void SpatialGrid::move(int id, const QPointF &pos) {
+    if (id < m_entries.size() && m_entries.at(id).slot >= 0 && m_entries.at(id).cell == cellOf(pos))
+        return;
+    insert(id, pos);
+}
+
+void SpatialGrid::clear() {
+    m_cells.clear();
+    m_entries.clear();
+}
+
+// Takes the item out of its cell by moving the cell's last item into its
+// slot, so nothing else shifts.
+void SpatialGrid::unlink(int id) {
+    Entry &entry = m_entries[id];
+    const auto cell = m_cells.find(entry.cell);
+    const int last = cell->takeLast();
+    if (last != id) {
+        (*cell)[entry.slot] = last;
+        m_entries[last].slot = entry.slot;
+    }
+    if (cell->isEmpty())
+        m_cells.erase(cell);
+    entry = Entry();
+}
@@ -0,0 +1,63 @@
+// spatialgrid.h
+
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <QtCore>
+#include <cmath>
+
+// Uniform grid of square cells over the positions of numbered items, kept
+// in a hash so only occupied cells cost memory. Moving an item within its
+// cell is a lookup; moving it to another cell is two constant-time list
+// edits. Queries visit the items in the cells overlapping a circle, which
+// is a superset of the items inside it.
+class SpatialGrid {
+public:
+    explicit SpatialGrid(qreal cellSize);
+
+    qreal cellSize() const { return m_cellSize; }
+
+    // Items are numbered densely from 0.
+    void insert(int id, const QPointF &pos);
+    void remove(int id);
+    void move(int id, const QPointF &pos);
+    void clear();
+
+    template <typename Visit>
+    void query(const QPointF &center, qreal radius, Visit visit) const {
+        if (m_cells.isEmpty())
+            return;
+        const int left = coordinate(center.x() - radius);
+        const int right = coordinate(center.x() + radius);
+        const int top = coordinate(center.y() - radius);
+        const int bottom = coordinate(center.y() + radius);
+        for (int y = top; y <= bottom; ++y) {
+            for (int x = left; x <= right; ++x) {
+                const auto cell = m_cells.constFind(key(x, y));
+                if (cell == m_cells.cend())
+                    continue;
+                for (int id : *cell)
+                    visit(id);
+            }
+        }
+    }
+
+private:
+    // Every 64 bit value is some cell's key, so whether an item is placed
+    // is told by its slot alone.
+    struct Entry {
+        quint64 cell = 0;
+        int slot = -1; // index in the cell's list, -1 if not placed
+    };
+
+    int coordinate(qreal v) const { return int(std::floor(v / m_cellSize)); }
+    quint64 cellOf(const QPointF &pos) const { return key(coordinate(pos.x()), coordinate(pos.y())); }
+    static quint64 key(int x, int y) { return quint64(quint32(x)) << 32 | quint32(y); }
+    void unlink(int id);
+
+    qreal m_cellSize;
+    QHash<quint64, QList<int>> m_cells;
+    QList<Entry> m_entries;
+};
+
+#endif // SPATIALGRID_H
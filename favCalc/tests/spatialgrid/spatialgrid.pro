@@ -0,0 +1,8 @@
+QT = core testlib
+CONFIG += testcase console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES = tst_spatialgrid.cpp ../../spatialgrid.cpp
+HEADERS = ../../spatialgrid.h
@@ -0,0 +1,67 @@
+// tst_spatialgrid.cpp
+
+#include <QtTest>
+#include <algorithm>
+
+#include "spatialgrid.h"
+
+class tst_SpatialGrid : public QObject {
+    Q_OBJECT
+
+private slots:
+    void moveThroughNegativeCell();
+    void removeFromNegativeCell();
+
+private:
+    static QList<int> itemsNear(const SpatialGrid &grid, const QPointF &center, qreal radius);
+};
+
+// Every visit, sorted, so repeated ids show up.
+QList<int> tst_SpatialGrid::itemsNear(const SpatialGrid &grid, const QPointF &center, qreal radius) {
+    QList<int> ids;
+    grid.query(center, radius, [&ids](int id) { ids.append(id); });
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+// Cell (-1, -1) has the key of all bits set, which once doubled as the
+// marker for an item not in any cell.
+void tst_SpatialGrid::moveThroughNegativeCell() {
+    SpatialGrid grid(50);
+    const QPointF inside(-35, -30);
+    const QPointF outside(100, 100);
+    grid.insert(0, inside);
+    grid.insert(1, QPointF(-10, -10));
+    grid.insert(2, outside);
+    QCOMPARE(itemsNear(grid, QPointF(-25, -25), 1), QList<int>({ 0, 1 }));
+
+    for (int i = 0; i < 10; ++i) {
+        grid.move(0, outside);
+        QCOMPARE(itemsNear(grid, QPointF(-25, -25), 1), QList<int>({ 1 }));
+        QCOMPARE(itemsNear(grid, QPointF(125, 125), 1), QList<int>({ 0, 2 }));
+
+        grid.move(0, inside);
+        grid.move(0, QPointF(-1, -1));
+        QCOMPARE(itemsNear(grid, QPointF(-25, -25), 1), QList<int>({ 0, 1 }));
+        QCOMPARE(itemsNear(grid, QPointF(125, 125), 1), QList<int>({ 2 }));
+    }
+}
+
+void tst_SpatialGrid::removeFromNegativeCell() {
+    SpatialGrid grid(50);
+    grid.insert(0, QPointF(-35, -30));
+    grid.insert(1, QPointF(-20, -5));
+    grid.remove(0);
+    QCOMPARE(itemsNear(grid, QPointF(-25, -25), 1), QList<int>({ 1 }));
+    grid.remove(0);
+    grid.insert(0, QPointF(-35, -30));
+    grid.insert(0, QPointF(-40, -40));
+    QCOMPARE(itemsNear(grid, QPointF(-25, -25), 1), QList<int>({ 0, 1 }));
+    grid.remove(1);
+    grid.remove(0);
+    QCOMPARE(itemsNear(grid, QPointF(-25, -25), 1), QList<int>());
+}
+
+QTEST_APPLESS_MAIN(tst_SpatialGrid)
+
+#include "tst_spatialgrid.moc"
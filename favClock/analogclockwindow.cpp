@@ -0,0 +1,114 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the examples of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:BSD$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** BSD License Usage
+** Alternatively, you may use this file under the terms of the BSD license
+** as follows:
+**
+** "Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are
+** met:
+**   * Redistributions of source code must retain the above copyright
+**     notice, this list of conditions and the following disclaimer.
+**   * Redistributions in binary form must reproduce the above copyright
+**     notice, this list of conditions and the following disclaimer in
+**     the documentation and/or other materials provided with the
+**     distribution.
+**   * Neither the name of The Qt Company Ltd nor the names of its
+**     contributors may be used to endorse or promote products derived
+**     from this software without specific prior written permission.
+**
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+** "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+** LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+** A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+** OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+** LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+** OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "analogclockwindow.h"
+
+//! [6]
+AnalogClockWindow::AnalogClockWindow()
+{
+    setTitle("Analog Clock");
+    resize(200, 200);
+    setBackgroundCached(true);
+    setAnimating(true);
+
+    // The seconds hand is retained: each frame only moves it, and the
+    // scene repaints where it was and where it is.
+    QPainterPath hand;
+    hand.lineTo(100, 0);
+    m_secondsHand = scene()->addLayer();
+    m_secondsHand->setPath(hand, ClockFace::secondsPen());
+}
+//! [6]
+
+AnalogClockWindow::~AnalogClockWindow()
+{
+    stopRendering();
+}
+
+QRegion AnalogClockWindow::damagedRegion()
+{
+    m_face.setGeometry(QRect(QPoint(), targetSize()), targetDevicePixelRatio());
+    m_clock.tick();
+    m_face.advance(m_clock);
+
+    m_secondsHand->setTransform(m_face.secondsTransform());
+
+    // Repaint where the sprite hands were and where they are now.
+    QRegion hands;
+    for (int hand = 0; hand < ClockFace::SecondsHand; ++hand)
+        hands += m_face.handRegion(ClockFace::Hand(hand));
+    const QRegion damage = hands + m_lastHandRegion;
+    m_lastHandRegion = hands;
+    return damage;
+}
+
+void AnalogClockWindow::renderBackground(QPainter *p)
+{
+    RasterWindow::renderBackground(p);
+    m_face.paintTicks(p);
+}
+
+//! [1]
+void AnalogClockWindow::render(QPainter *p)
+{
+    for (int hand = 0; hand < ClockFace::SecondsHand; ++hand)
+        m_face.paintHand(p, ClockFace::Hand(hand));
+}
+//! [1]
+
+int AnalogClockWindow::layerCount() const
+{
+    return ClockFace::SecondsHand;
+}
+
+void AnalogClockWindow::renderLayer(int layer, QPainter *p)
+{
+    m_face.paintHand(p, ClockFace::Hand(layer));
+}
@@ -0,0 +1,37 @@
+// animationclock.cpp
+
+#include "animationclock.h"
+
+static const qint64 kNsecsPerDay = 24LL * 60 * 60 * 1000 * 1000 * 1000;
+
+AnimationClock::AnimationClock(qint64 stepInterval)
+    : m_stepInterval(qMax<qint64>(1, stepInterval))
+{
+    m_timer.start();
+    restart();
+}
+
+void AnimationClock::setTimeSource(TimeSource *source)
+{
+    m_source.reset(source);
+    restart();
+}
+
+void AnimationClock::restart()
+{
+    m_origin = m_source ? m_source->nsecsElapsed() : m_timer.nsecsElapsed();
+    m_elapsed = 0;
+    m_startTime = QTime::currentTime();
+}
+
+void AnimationClock::tick()
+{
+    const qint64 now = m_source ? m_source->nsecsElapsed() : m_timer.nsecsElapsed();
+    // Monotonic even if a virtual source is set back.
+    m_elapsed = qMax(m_elapsed, now - m_origin);
+}
+
+qint64 AnimationClock::timeOfDay() const
+{
+    return (m_startTime.msecsSinceStartOfDay() * 1000000LL + m_elapsed) % kNsecsPerDay;
+}
@@ -0,0 +1,72 @@
+// animationclock.h
+
+#ifndef ANIMATIONCLOCK_H
+#define ANIMATIONCLOCK_H
+
+#include <QtGui>
+
+// Time for the clock animations, sampled once per frame.
+//
+// Time comes from a monotonic source, by default a QElapsedTimer, and the
+// time of day shown is the wall clock read once at restart() plus the
+// monotonic time since, so it never jumps while running. State that
+// changes in discrete steps advances at a fixed interval whatever the
+// frame rate; stepProgress() tells how far the frame is between the last
+// step and the next, for interpolating what is drawn.
+//
+// A VirtualTimeSource makes the animation a pure function of the time it
+// is set to, for rendering exports and benchmarks deterministically.
+class AnimationClock
+{
+public:
+    class TimeSource
+    {
+    public:
+        virtual ~TimeSource() = default;
+        virtual qint64 nsecsElapsed() const = 0;
+    };
+
+    class VirtualTimeSource : public TimeSource
+    {
+    public:
+        qint64 nsecsElapsed() const override { return m_time; }
+        void setTime(qint64 nsecs) { m_time = nsecs; }
+        void advance(qint64 nsecs) { m_time += nsecs; }
+
+    private:
+        qint64 m_time = 0;
+    };
+
+    explicit AnimationClock(qint64 stepInterval = 50 * 1000 * 1000);
+
+    // Takes ownership; null goes back to the monotonic timer. Restarts the
+    // clock, so set the start time afterwards.
+    void setTimeSource(TimeSource *source);
+
+    // Elapsed time and steps start over from zero, and the start time
+    // becomes the current time of day.
+    void restart();
+
+    void setStartTime(const QTime &time) { m_startTime = time; }
+    QTime startTime() const { return m_startTime; }
+
+    // Samples the time source; everything below refers to that instant.
+    void tick();
+
+    qint64 elapsed() const { return m_elapsed; }
+    qint64 timeOfDay() const; // nanoseconds since midnight
+
+    qint64 stepInterval() const { return m_stepInterval; }
+    qint64 stepCount() const { return m_elapsed / m_stepInterval; }
+    qreal stepProgress() const { return qreal(m_elapsed % m_stepInterval) / m_stepInterval; }
+
+private:
+    QElapsedTimer m_timer;
+    QScopedPointer<TimeSource> m_source;
+    qint64 m_origin = 0;
+    qint64 m_elapsed = 0;
+    qint64 m_stepInterval;
+    QTime m_startTime;
+};
+
+#endif // ANIMATIONCLOCK_H
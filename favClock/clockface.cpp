@@ -0,0 +1,236 @@
+// clockface.cpp
+
+#include "clockface.h"
+#include "spriteasset.h"
+
+static const QColor hourColor(127, 0, 127);
+static const QColor minuteColor(0, 127, 127, 191);
+
+// Steps of the seconds hand's random walk replayed at most after a pause;
+// older ones are skipped.
+static const qint64 kMaxCatchUpSteps = 1200;
+
+// The decoded mip chain of each sprite, loaded once per process. Faces may
+// be laid out on a render thread, so the caches are locked.
+static QList<QImage> spriteLevels(const QString &name)
+{
+    static QMutex mutex;
+    static QHash<QString, QList<QImage>> cache;
+    QMutexLocker locker(&mutex);
+    auto it = cache.find(name);
+    if (it == cache.end()) {
+        QList<QImage> levels = SpriteAsset::load(name).levels();
+        if (levels.size() == 1)
+            levels = SpriteAsset::mipChain(levels.first());
+        it = cache.insert(name, levels);
+    }
+    return it.value();
+}
+
+QSharedPointer<const ClockSprites> ClockSprites::get(int side, qreal devicePixelRatio)
+{
+    static QMutex mutex;
+    static QHash<QPair<int, qreal>, QWeakPointer<const ClockSprites>> cache;
+    QMutexLocker locker(&mutex);
+
+    const QPair<int, qreal> key(side, devicePixelRatio);
+    if (QSharedPointer<const ClockSprites> sprites = cache.value(key).toStrongRef())
+        return sprites;
+
+    cache.removeIf([](const auto &entry) { return entry.value().isNull(); });
+    QSharedPointer<const ClockSprites> sprites(new ClockSprites(side, devicePixelRatio));
+    cache.insert(key, sprites);
+    return sprites;
+}
+
+ClockSprites::ClockSprites(int side, qreal devicePixelRatio)
+    // Hand sizes are in clock units (the face is 200 units wide), origins in
+    // image pixels relative to the point the hand rotates around.
+    : boing(spriteLevels("boing01"), QSizeF(150, 150), QPointF(-375, -375))
+    , pingu(spriteLevels("pingu01"), QSizeF(40, 100), QPointF(-120, -685))
+    , scream(spriteLevels("scream01"), QSizeF(40, 80), QPointF(-170, -650))
+{
+    boing.prepare(side / 200.0, devicePixelRatio);
+    pingu.prepare(side / 200.0, devicePixelRatio);
+    scream.prepare(side / 200.0, devicePixelRatio);
+
+    ticks = QImage(QSize(side, side) * devicePixelRatio, QImage::Format_ARGB32_Premultiplied);
+    ticks.setDevicePixelRatio(devicePixelRatio);
+    ticks.fill(Qt::transparent);
+
+    QPainter p(&ticks);
+    p.setRenderHint(QPainter::Antialiasing);
+    p.translate(side / 2.0, side / 2.0);
+    p.scale(side / 200.0, side / 200.0);
+
+//! [12]
+    p.setPen(hourColor);
+
+    for (int i = 0; i < 12; ++i) {
+        p.drawLine(88, 0, 96, 0);
+        p.rotate(30.0);
+    }
+//! [12]
+
+//! [4]
+    p.setPen(minuteColor);
+
+    for (int j = 0; j < 60; ++j) {
+        if ((j % 5) != 0)
+            p.drawLine(92, 0, 96, 0);
+        p.rotate(6.0);
+    }
+//! [4]
+}
+
+ClockFace::ClockFace(quint32 seed)
+    : m_random(seed)
+{
+}
+
+void ClockFace::setGeometry(const QRect &rect, qreal devicePixelRatio)
+{
+    const int side = qMin(rect.width(), rect.height());
+    if (!m_sprites || side != qMin(m_rect.width(), m_rect.height())
+            || devicePixelRatio != m_devicePixelRatio)
+        m_sprites = ClockSprites::get(side, devicePixelRatio);
+
+    m_rect = rect;
+    m_devicePixelRatio = devicePixelRatio;
+}
+
+QPointF ClockFace::center() const
+{
+    return QPointF(m_rect.x() + m_rect.width() / 2.0, m_rect.y() + m_rect.height() / 2.0);
+}
+
+qreal ClockFace::scale() const
+{
+    return qMin(m_rect.width(), m_rect.height()) / 200.0;
+}
+
+void ClockFace::advance(const AnimationClock &clock)
+{
+//! [14]
+    // The seconds hand takes a random step per clock step, whatever the
+    // frame rate, and is drawn part way between its last two positions.
+    const qint64 due = clock.stepCount() - m_stepCount;
+    for (qint64 i = qMax<qint64>(0, due - kMaxCatchUpSteps); i < due; ++i) {
+        m_previousSeconds = m_seconds;
+        if (m_random.bounded(20) < 3)
+            ++m_seconds;
+    }
+    if (m_previousSeconds >= 60) {
+        m_previousSeconds -= 60;
+        m_seconds -= 60;
+    }
+    // A restarted clock counts from zero again.
+    m_stepCount = clock.stepCount();
+    m_secondsAngle = 6.0 * (m_previousSeconds + (m_seconds - m_previousSeconds) * clock.stepProgress());
+//! [14]
+
+    // The other hands turn with the time of day; 'ticks' counts 50 ms units
+    // into the current minute.
+    const qreal ticks = (clock.timeOfDay() % 60000000000LL) / 50e6;
+    m_boingAngle = 360.0 * 5.0 / 1200.0 * ticks;
+    m_pinguAngle = -360.0 * 3.0 / 1200.0 * ticks;
+    m_screamAngle = 360.0 * 9.0 / 1200.0 * ticks;
+}
+
+QRegion ClockFace::handRegion() const
+{
+    QRegion region;
+    for (int hand = 0; hand < HandCount; ++hand)
+        region += handRegion(Hand(hand));
+    return region;
+}
+
+QRegion ClockFace::handRegion(Hand hand) const
+{
+    if (!m_sprites)
+        return QRegion();
+
+    switch (hand) {
+    case BoingHand:
+        return m_sprites->boing.boundingRect(center(), m_boingAngle);
+    case PinguHand:
+        return m_sprites->pingu.boundingRect(center(), m_pinguAngle);
+    case ScreamHand:
+        return m_sprites->scream.boundingRect(center(), m_screamAngle);
+    case SecondsHand: {
+        const QLineF secondHand = secondsTransform().map(QLineF(0, 0, 100, 0));
+        const QRectF secondRect = QRectF(secondHand.p1(), secondHand.p2()).normalized();
+        // Half the scaled pen, rounded up, plus a pixel of antialiased edge.
+        const qreal penWidth = qMax<qreal>(secondsPen().widthF(), 1);
+        const int m = qCeil(penWidth * scale() / 2) + 1;
+        return secondRect.toAlignedRect().adjusted(-m, -m, m, m);
+    }
+    case HandCount:
+        break;
+    }
+    return QRegion();
+}
+
+QTransform ClockFace::secondsTransform() const
+{
+    QTransform transform = QTransform::fromTranslate(center().x(), center().y());
+    transform.scale(scale(), scale());
+    transform.rotate(m_secondsAngle);
+    return transform;
+}
+
+QPen ClockFace::secondsPen()
+{
+    return QPen(minuteColor);
+}
+
+void ClockFace::paintTicks(QPainter *painter) const
+{
+    if (!m_sprites)
+        return;
+
+    const qreal side = qMin(m_rect.width(), m_rect.height());
+    painter->drawImage(center() - QPointF(side / 2.0, side / 2.0), m_sprites->ticks);
+}
+
+// Only reads state, so the hands of one face can be painted from several
+// threads at once.
+void ClockFace::paintHand(QPainter *painter, Hand hand) const
+{
+    if (!m_sprites)
+        return;
+
+    painter->save();
+//! [9]
+    painter->setRenderHint(QPainter::Antialiasing);
+//! [9]
+    switch (hand) {
+    case BoingHand:
+//! [2]
+        m_sprites->boing.draw(painter, center(), m_boingAngle);
+//! [2]
+        break;
+    case PinguHand:
+//! [3]
+        m_sprites->pingu.draw(painter, center(), m_pinguAngle);
+//! [3]
+        break;
+    case ScreamHand:
+        m_sprites->scream.draw(painter, center(), m_screamAngle);
+        break;
+    case SecondsHand:
+        painter->setTransform(secondsTransform(), true);
+        painter->setPen(secondsPen());
+        painter->drawLine(0, 0, 100, 0);
+        break;
+    case HandCount:
+        break;
+    }
+    painter->restore();
+}
+
+void ClockFace::paintHands(QPainter *painter) const
+{
+    for (int hand = 0; hand < HandCount; ++hand)
+        paintHand(painter, Hand(hand));
+}
@@ -0,0 +1,75 @@
+// clockface.h
+
+#ifndef CLOCKFACE_H
+#define CLOCKFACE_H
+
+#include <QtGui>
+
+#include "animationclock.h"
+#include "spriteatlas.h"
+
+// Everything about a clock face that only depends on its size: the hand
+// atlases and the tick marks. Instances are immutable and shared by all
+// faces of the same size and device pixel ratio; they are released when
+// the last face using them moves on.
+class ClockSprites
+{
+public:
+    static QSharedPointer<const ClockSprites> get(int side, qreal devicePixelRatio);
+
+    SpriteAtlas boing, pingu, scream;
+    QImage ticks; // side x side logical pixels, centered on the face
+
+private:
+    ClockSprites(int side, qreal devicePixelRatio);
+};
+
+// One animated clock: the hand state plus how to paint it into a rectangle
+// of a RasterWindow.
+class ClockFace
+{
+public:
+    enum Hand { BoingHand, PinguHand, ScreamHand, SecondsHand, HandCount };
+
+    explicit ClockFace(quint32 seed = 1);
+
+    void setGeometry(const QRect &rect, qreal devicePixelRatio);
+    QRect geometry() const { return m_rect; }
+
+    // Runs the seconds hand's random walk up to the clock's current step
+    // and poses all hands at the clock's current time.
+    void advance(const AnimationClock &clock);
+
+    // Where paintHands() (or paintHand()) draws, for damage tracking.
+    QRegion handRegion() const;
+    QRegion handRegion(Hand hand) const;
+
+    // The seconds hand is a line 100 clock units long along the x axis,
+    // drawn with secondsPen() under secondsTransform().
+    QTransform secondsTransform() const;
+    static QPen secondsPen();
+
+    void paintTicks(QPainter *painter) const;
+    void paintHand(QPainter *painter, Hand hand) const;
+    void paintHands(QPainter *painter) const;
+
+private:
+    QPointF center() const;
+    qreal scale() const;
+
+    QRect m_rect;
+    qreal m_devicePixelRatio = 0;
+    QSharedPointer<const ClockSprites> m_sprites;
+
+    QRandomGenerator m_random;
+    qint64 m_stepCount = 0;
+    int m_seconds = 0;
+    int m_previousSeconds = 0;
+
+    qreal m_boingAngle = 0;
+    qreal m_pinguAngle = 0;
+    qreal m_screamAngle = 0;
+    qreal m_secondsAngle = 0;
+};
+
+#endif // CLOCKFACE_H
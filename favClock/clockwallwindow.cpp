@@ -0,0 +1,78 @@
+// clockwallwindow.cpp
+
+#include "clockwallwindow.h"
+
+#include <cmath>
+
+ClockWallWindow::ClockWallWindow(int count)
+{
+    setTitle("Clock Wall");
+    resize(1200, 800);
+    setBackgroundCached(true);
+    setAnimating(true);
+
+    // A different seed per face so the seconds hands wander independently.
+    for (int i = 0; i < count; ++i)
+        m_faces.append(ClockFace(quint32(i + 1)));
+}
+
+ClockWallWindow::~ClockWallWindow()
+{
+    stopRendering();
+}
+
+void ClockWallWindow::layoutFaces()
+{
+    const int count = int(m_faces.size());
+    if (count == 0)
+        return;
+
+    // Roughly square tiles; all of the same size so they share sprites.
+    const QSize size = targetSize();
+    const int columns = qBound(1, int(std::ceil(std::sqrt(qreal(count) * size.width() / qMax(1, size.height())))), count);
+    const int rows = (count + columns - 1) / columns;
+    const QSize tile(size.width() / columns, size.height() / rows);
+
+    for (int i = 0; i < count; ++i) {
+        const QRect rect(QPoint(i % columns * tile.width(), i / columns * tile.height()), tile);
+        m_faces[i].setGeometry(rect, targetDevicePixelRatio());
+    }
+    m_layoutSize = size;
+}
+
+QRegion ClockWallWindow::damagedRegion()
+{
+    if (m_layoutSize != targetSize())
+        layoutFaces();
+
+    m_clock.tick();
+
+    QRegion hands;
+    for (ClockFace &face : m_faces) {
+        face.setGeometry(face.geometry(), targetDevicePixelRatio());
+        face.advance(m_clock);
+        // One rectangle per tile keeps the region cheap with hundreds of faces.
+        hands += face.handRegion().boundingRect() & face.geometry();
+    }
+
+    const QRegion damage = hands + m_lastHandRegion;
+    m_lastHandRegion = hands;
+    return damage;
+}
+
+void ClockWallWindow::renderBackground(QPainter *p)
+{
+    RasterWindow::renderBackground(p);
+    for (const ClockFace &face : std::as_const(m_faces))
+        face.paintTicks(p);
+}
+
+void ClockWallWindow::render(QPainter *p)
+{
+    for (const ClockFace &face : std::as_const(m_faces)) {
+        p->save();
+        p->setClipRect(face.geometry(), Qt::IntersectClip);
+        face.paintHands(p);
+        p->restore();
+    }
+}
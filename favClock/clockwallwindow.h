@@ -0,0 +1,36 @@
+// clockwallwindow.h
+
+#ifndef CLOCKWALLWINDOW_H
+#define CLOCKWALLWINDOW_H
+
+#include <QtGui>
+
+#include "clockface.h"
+#include "rasterwindow.h"
+
+// Many clocks tiled into one window. All faces are driven by the window's
+// single frame scheduler and one animation clock ticked once per frame and,
+// being the same size, share one set of hand atlases and tick marks.
+class ClockWallWindow : public RasterWindow
+{
+public:
+    explicit ClockWallWindow(int count);
+    ~ClockWallWindow();
+
+    AnimationClock *animationClock() { return &m_clock; }
+
+protected:
+    void render(QPainter *p) override;
+    void renderBackground(QPainter *p) override;
+    QRegion damagedRegion() override;
+
+private:
+    void layoutFaces();
+
+    QList<ClockFace> m_faces;
+    AnimationClock m_clock;
+    QSize m_layoutSize;
+    QRegion m_lastHandRegion;
+};
+
+#endif // CLOCKWALLWINDOW_H
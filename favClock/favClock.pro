@@ -4,7 +4,23 @@ include(../rasterwindow/rasterwindow.pri)
 CONFIG += no_batch
 
 SOURCES += \
-    main.cpp
+    analogclockwindow.cpp \
+    animationclock.cpp \
+    clockface.cpp \
+    clockwallwindow.cpp \
+    frameexporter.cpp \
+    spriteasset.cpp \
+    main.cpp \
+    spriteatlas.cpp
+
+HEADERS += \
+    analogclockwindow.h \
+    animationclock.h \
+    clockface.h \
+    clockwallwindow.h \
+    frameexporter.h \
+    spriteasset.h \
+    spriteatlas.h
 
 RESOURCES = favClock.qrc
 
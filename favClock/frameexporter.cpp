@@ -0,0 +1,260 @@
+// frameexporter.cpp
+
+#include "frameexporter.h"
+#include "analogclockwindow.h"
+
+#include <cstdio>
+#include <cstring>
+
+FrameExporter::FrameExporter(const Options &options)
+    : m_options(options)
+{
+    m_options.fps = qMax(1, m_options.fps);
+    m_options.frameCount = qMax(0, m_options.frameCount);
+    m_options.ringSize = qMax(2, m_options.ringSize);
+}
+
+bool FrameExporter::parseFormat(const QString &name, Format *format)
+{
+    if (name == QLatin1String("png"))
+        *format = PngSequence;
+    else if (name == QLatin1String("ppm"))
+        *format = PpmSequence;
+    else if (name == QLatin1String("y4m"))
+        *format = Y4mStream;
+    else
+        return false;
+    return true;
+}
+
+// Copies the pixels of 'region' (in logical coordinates) between two images
+// of the same size and device pixel ratio.
+static void copyRegion(const QImage &source, QImage *target, const QRegion &region)
+{
+    const qreal dpr = source.devicePixelRatio();
+    const QRect bounds = source.rect();
+    for (const QRect &rect : region) {
+        const QRect pixels = QRectF(rect.x() * dpr, rect.y() * dpr,
+                                    rect.width() * dpr, rect.height() * dpr).toAlignedRect() & bounds;
+        const qsizetype bytes = qsizetype(pixels.width()) * 4;
+        for (int y = pixels.top(); y <= pixels.bottom(); ++y) {
+            memcpy(target->scanLine(y) + pixels.left() * 4,
+                   source.constScanLine(y) + pixels.left() * 4, bytes);
+        }
+    }
+}
+
+bool FrameExporter::run(AnalogClockWindow *window)
+{
+    const Options &o = m_options;
+    const QSize pixelSize = o.size * o.devicePixelRatio;
+
+    if (o.format == Y4mStream) {
+        bool opened;
+        if (o.output == QLatin1String("-")) {
+            opened = m_stream.open(stdout, QIODevice::WriteOnly);
+        } else {
+            m_stream.setFileName(o.output);
+            opened = m_stream.open(QIODevice::WriteOnly);
+        }
+        if (!opened) {
+            m_errorString = QStringLiteral("cannot open %1: %2").arg(o.output, m_stream.errorString());
+            return false;
+        }
+        m_stream.write(QStringLiteral("YUV4MPEG2 W%1 H%2 F%3:1 Ip A1:1 C420jpeg\n")
+                       .arg(pixelSize.width()).arg(pixelSize.height()).arg(o.fps).toLatin1());
+    } else if (!QDir().mkpath(o.output)) {
+        m_errorString = QStringLiteral("cannot create %1").arg(o.output);
+        return false;
+    }
+
+    window->resize(o.size);
+    QImage canvas(pixelSize, QImage::Format_ARGB32_Premultiplied);
+    canvas.setDevicePixelRatio(o.devicePixelRatio);
+
+    m_slots.resize(o.ringSize);
+    for (int i = 0; i < o.ringSize; ++i) {
+        m_slots[i].image = QImage(pixelSize, QImage::Format_ARGB32_Premultiplied);
+        m_slots[i].image.setDevicePixelRatio(o.devicePixelRatio);
+        m_slots[i].stale = QRect(QPoint(0, 0), o.size);
+        m_freeSlots.enqueue(i);
+    }
+
+    // The frames only depend on the frame number.
+    AnimationClock *clock = window->animationClock();
+    AnimationClock::VirtualTimeSource *time = new AnimationClock::VirtualTimeSource;
+    clock->setTimeSource(time);
+    clock->setStartTime(o.startTime);
+
+    QScopedPointer<QThread> encoder(QThread::create([this] { encodeFrames(); }));
+    encoder->start();
+
+    for (int frame = 0; frame < o.frameCount; ++frame) {
+        time->setTime(qint64(frame) * 1000000000 / o.fps);
+        const QRegion damage = window->renderTo(&canvas);
+        for (Slot &slot : m_slots)
+            slot.stale += damage;
+
+        const int index = acquireFree();
+        if (index < 0)
+            break;
+        Slot &slot = m_slots[index];
+        copyRegion(canvas, &slot.image, slot.stale);
+        slot.stale = QRegion();
+        slot.frame = frame;
+
+        QMutexLocker locker(&m_mutex);
+        m_readySlots.enqueue(index);
+        m_ready.wakeOne();
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_finished = true;
+        m_ready.wakeOne();
+    }
+    encoder->wait();
+    clock->setTimeSource(nullptr);
+
+    if (m_stream.isOpen())
+        m_stream.close();
+    return !m_failed;
+}
+
+int FrameExporter::acquireFree()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_freeSlots.isEmpty() && !m_failed)
+        m_freed.wait(&m_mutex);
+    return m_failed ? -1 : m_freeSlots.dequeue();
+}
+
+int FrameExporter::acquireReady()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_readySlots.isEmpty() && !m_finished)
+        m_ready.wait(&m_mutex);
+    return m_readySlots.isEmpty() ? -1 : m_readySlots.dequeue();
+}
+
+// Runs on the encoder thread. Slots it holds are not touched by the
+// renderer until they are handed back.
+void FrameExporter::encodeFrames()
+{
+    for (int index = acquireReady(); index >= 0; index = acquireReady()) {
+        const bool written = encode(m_slots.at(index));
+        QMutexLocker locker(&m_mutex);
+        if (!written) {
+            m_failed = true;
+            m_freed.wakeOne();
+            return;
+        }
+        m_freeSlots.enqueue(index);
+        m_freed.wakeOne();
+    }
+}
+
+// The slots hold premultiplied pixels, which the writers would take for
+// straight color wherever a frame is not opaque. RGB32 un-premultiplies
+// them and drops the alpha, which PPM and Y4M cannot store; PNG frames are
+// written opaque too, so every format shows the same pixels.
+bool FrameExporter::encode(const Slot &slot)
+{
+    const QImage image = slot.image.convertToFormat(QImage::Format_RGB32);
+    if (m_options.format == Y4mStream)
+        return writeY4mFrame(image);
+    return writeImageFile(image, slot.frame);
+}
+
+void FrameExporter::fail(const QString &error)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_errorString.isEmpty())
+        m_errorString = error;
+}
+
+// 'image' is RGB32, so its channels are straight color.
+bool FrameExporter::writeImageFile(const QImage &image, int frame)
+{
+    const bool png = m_options.format == PngSequence;
+    const QString fileName = QStringLiteral("%1/frame%2.%3").arg(m_options.output)
+            .arg(frame, 5, 10, QLatin1Char('0')).arg(QLatin1String(png ? "png" : "ppm"));
+
+    if (png) {
+        if (image.save(fileName, "PNG"))
+            return true;
+        fail(QStringLiteral("cannot write %1").arg(fileName));
+        return false;
+    }
+
+    const QByteArray header = QStringLiteral("P6\n%1 %2\n255\n")
+            .arg(image.width()).arg(image.height()).toLatin1();
+    m_buffer.resize(header.size() + qsizetype(image.width()) * image.height() * 3);
+    memcpy(m_buffer.data(), header.constData(), header.size());
+    uchar *out = reinterpret_cast<uchar *>(m_buffer.data()) + header.size();
+    for (int y = 0; y < image.height(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            *out++ = uchar(qRed(line[x]));
+            *out++ = uchar(qGreen(line[x]));
+            *out++ = uchar(qBlue(line[x]));
+        }
+    }
+
+    QFile file(fileName);
+    if (file.open(QIODevice::WriteOnly) && file.write(m_buffer) == m_buffer.size())
+        return true;
+    fail(QStringLiteral("cannot write %1: %2").arg(fileName, file.errorString()));
+    return false;
+}
+
+// BT.601 studio range, chroma averaged over 2x2 blocks (C420jpeg siting).
+// 'image' is RGB32.
+bool FrameExporter::writeY4mFrame(const QImage &image)
+{
+    const int width = image.width();
+    const int height = image.height();
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+    const qsizetype lumaSize = qsizetype(width) * height;
+    const qsizetype chromaSize = qsizetype(chromaWidth) * chromaHeight;
+
+    static const char frameHeader[] = "FRAME\n";
+    const qsizetype headerSize = sizeof(frameHeader) - 1;
+    m_buffer.resize(headerSize + lumaSize + 2 * chromaSize);
+    memcpy(m_buffer.data(), frameHeader, headerSize);
+    uchar *yPlane = reinterpret_cast<uchar *>(m_buffer.data()) + headerSize;
+    uchar *uPlane = yPlane + lumaSize;
+    uchar *vPlane = uPlane + chromaSize;
+
+    for (int cy = 0; cy < chromaHeight; ++cy) {
+        const QRgb *lines[2] = {
+            reinterpret_cast<const QRgb *>(image.constScanLine(2 * cy)),
+            reinterpret_cast<const QRgb *>(image.constScanLine(qMin(2 * cy + 1, height - 1)))
+        };
+        for (int cx = 0; cx < chromaWidth; ++cx) {
+            int r = 0, g = 0, b = 0;
+            for (int dy = 0; dy < 2; ++dy) {
+                for (int dx = 0; dx < 2; ++dx) {
+                    const int x = qMin(2 * cx + dx, width - 1);
+                    const QRgb pixel = lines[dy][x];
+                    const int pr = qRed(pixel), pg = qGreen(pixel), pb = qBlue(pixel);
+                    r += pr;
+                    g += pg;
+                    b += pb;
+                    const int y = 2 * cy + dy;
+                    if (y < height && 2 * cx + dx < width)
+                        yPlane[qsizetype(y) * width + x] = uchar(((66 * pr + 129 * pg + 25 * pb + 128) >> 8) + 16);
+                }
+            }
+            // Sums of four samples: scale the coefficients down by 4 more.
+            uPlane[qsizetype(cy) * chromaWidth + cx] = uchar(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+            vPlane[qsizetype(cy) * chromaWidth + cx] = uchar(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+        }
+    }
+
+    if (m_stream.write(m_buffer) == m_buffer.size())
+        return true;
+    fail(QStringLiteral("cannot write %1: %2").arg(m_options.output, m_stream.errorString()));
+    return false;
+}
@@ -0,0 +1,78 @@
+// frameexporter.h
+
+#ifndef FRAMEEXPORTER_H
+#define FRAMEEXPORTER_H
+
+#include <QtGui>
+
+class AnalogClockWindow;
+
+// Renders a clock headlessly at fixed time steps and writes the frames as an
+// image sequence or a raw video stream.
+//
+// Rendering and encoding are pipelined: the calling thread renders into a
+// small ring of reused images while an encoder thread writes the previous
+// ones. The clock is rendered incrementally into one canvas, and each ring
+// image only receives the pixels that changed since it was last filled.
+class FrameExporter
+{
+public:
+    enum Format {
+        PngSequence, // <output>/frame00000.png, ...
+        PpmSequence, // <output>/frame00000.ppm, ... (binary P6)
+        Y4mStream    // one YUV4MPEG2 4:2:0 file, or stdout for "-"
+    };
+
+    struct Options
+    {
+        Format format = PngSequence;
+        QString output;
+        QSize size = QSize(200, 200);
+        qreal devicePixelRatio = 1;
+        int fps = 30;
+        int frameCount = 300;
+        QTime startTime = QTime(10, 8, 0);
+        int ringSize = 4;
+    };
+
+    explicit FrameExporter(const Options &options);
+
+    // Renders and writes every frame; false on the first write error.
+    bool run(AnalogClockWindow *window);
+    QString errorString() const { return m_errorString; }
+
+    static bool parseFormat(const QString &name, Format *format);
+
+private:
+    struct Slot
+    {
+        QImage image;
+        QRegion stale;
+        int frame = 0;
+    };
+
+    int acquireFree();
+    int acquireReady();
+    void encodeFrames();
+    bool encode(const Slot &slot);
+    bool writeImageFile(const QImage &image, int frame);
+    bool writeY4mFrame(const QImage &image);
+    void fail(const QString &error);
+
+    Options m_options;
+    QString m_errorString;
+
+    QList<Slot> m_slots;
+    QMutex m_mutex;
+    QWaitCondition m_freed;
+    QWaitCondition m_ready;
+    QQueue<int> m_freeSlots;
+    QQueue<int> m_readySlots;
+    bool m_finished = false;
+    bool m_failed = false;
+
+    QFile m_stream;
+    QByteArray m_buffer;
+};
+
+#endif // FRAMEEXPORTER_H
@@ -50,149 +50,107 @@
 
 #include <QtGui>
 
-#include "rasterwindow.h"
+#include "analogclockwindow.h"
+#include "clockwallwindow.h"
+#include "frameexporter.h"
 
-//! [5]
-class AnalogClockWindow : public RasterWindow
+static int exportFrames(const QCommandLineParser &parser)
 {
-public:
-    AnalogClockWindow();
-
-protected:
-    void timerEvent(QTimerEvent *) override;
-    void render(QPainter *p) override;
-
-private:
-    int m_timerId;
-    QImage boing, pingu, scream;
-    QRandomGenerator random;
-};
-//! [5]
-
-
-//! [6]
-AnalogClockWindow::AnalogClockWindow()
-{
-    setTitle("Analog Clock");
-    resize(200, 200);
-
-    m_timerId = startTimer(50);
-
-    boing.load(":images/boing01.png");
-    pingu.load(":images/pingu01.png");
-    scream.load(":images/scream01.png");
-}
-//! [6]
-
-//! [7]
-void AnalogClockWindow::timerEvent(QTimerEvent *event)
-{
-    if (event->timerId() == m_timerId)
-        renderLater();
-}
-//! [7]
-
-//! [1] //! [14]
-void AnalogClockWindow::render(QPainter *p)
-{
-    static int seconds = 0;
-
-    if (random.bounded(20) < 3) seconds++;
-//! [14]
-//! [8]
-    static const QPoint hourHand[3] = {
-        QPoint(7, 8),
-        QPoint(-7, 8),
-        QPoint(0, -40)
-    };
-    static const QPoint minuteHand[3] = {
-        QPoint(7, 8),
-        QPoint(-7, 8),
-        QPoint(0, -70)
-    };
-
-    QColor hourColor(127, 0, 127);
-    QColor minuteColor(0, 127, 127, 191);
-//! [8]
-
-//! [9]
-    p->setRenderHint(QPainter::Antialiasing);
-//! [9] //! [10]
-    p->translate(width() / 2, height() / 2);
-
-    int side = qMin(width(), height());
-    p->scale(side / 200.0, side / 200.0);
-//! [1] //! [10]
-
-//! [11]
-    p->setPen(Qt::NoPen);
-    p->setBrush(hourColor);
-//! [11]
-
-//! [2]
-    QTime time = QTime::currentTime();
-
-    p->save();
-    p->scale(150.0 / boing.width(), 150.0 / boing.height());
-    p->rotate(360.0 * 5.0 / 1200.0 * (time.second() * 20.0 + time.msec() / 50.0));
-    p->drawImage(QPointF(-375.0, -375.0), boing);
-    //p->drawConvexPolygon(hourHand, 3);
-    p->restore();
-//! [2]
-
-//! [12]
-    p->setPen(hourColor);
-
-    for (int i = 0; i < 12; ++i) {
-        p->drawLine(88, 0, 96, 0);
-        p->rotate(30.0);
+    FrameExporter::Options options;
+    options.output = parser.value("export");
+    if (!FrameExporter::parseFormat(parser.value("format"), &options.format)) {
+        qWarning("Unknown export format %s", qPrintable(parser.value("format")));
+        return 1;
     }
-//! [12] //! [13]
-    p->setPen(Qt::NoPen);
-    p->setBrush(minuteColor);
-//! [13]
-
-//! [3]
-    p->save();
-    p->scale(40.0 / pingu.width(), 100.0 / pingu.height());
-    p->rotate(-360.0 * 3.0 / 1200.0 * (time.second() * 20.0 + time.msec() / 50.0));
-    // p->drawConvexPolygon(minuteHand, 3);
-    p->drawImage(QPoint(-120.0, -685.0), pingu);
-    p->restore();
-//! [3]
-
-//! [4]
-    p->setPen(minuteColor);
-
-    for (int j = 0; j < 60; ++j) {
-        if ((j % 5) != 0)
-            p->drawLine(92, 0, 96, 0);
-        p->rotate(6.0);
+    const QStringList size = parser.value("size").split('x');
+    if (size.size() == 2)
+        options.size = QSize(size.at(0).toInt(), size.at(1).toInt()).expandedTo(QSize(1, 1));
+    options.devicePixelRatio = qMax<qreal>(0.25, parser.value("dpr").toDouble());
+    options.fps = parser.value("fps").toInt();
+    options.frameCount = parser.value("frames").toInt();
+    options.startTime = QTime::fromString(parser.value("start"), "hh:mm:ss");
+    if (!options.startTime.isValid()) {
+        qWarning("Invalid start time %s", qPrintable(parser.value("start")));
+        return 1;
     }
-//! [4]
 
-    p->save();
-    p->scale(40.0 / scream.width(), 80.0 / scream.height());
-    p->rotate(360.0 * 9.0 / 1200.0 * (time.second() * 20.0 + time.msec() / 50.0));
-    p->drawImage(QPoint(-170.0, -650.0), scream);
-    // p->drawLine(0, 0, 100, 0);
-    p->restore();
-
-    //seconds
-    p->save();
-    p->rotate(6.0 * seconds);
-    p->drawLine(0, 0, 100, 0);
-    p->restore();
-
-    seconds %= 60;
+    AnalogClockWindow clock;
+    clock.setAnimating(false);
+    clock.setParallelRendering(parser.isSet("parallel"));
+
+    QElapsedTimer timer;
+    timer.start();
+    FrameExporter exporter(options);
+    if (!exporter.run(&clock)) {
+        qWarning("Export failed: %s", qPrintable(exporter.errorString()));
+        return 1;
+    }
+    const qreal seconds = timer.nsecsElapsed() / 1e9;
+    qInfo("Exported %d frames in %.2f s (%.1f fps)", options.frameCount, seconds,
+          seconds > 0 ? options.frameCount / seconds : 0.0);
+    return 0;
 }
 
 int main(int argc, char **argv)
 {
-    QGuiApplication app(argc, argv);
+    // Exporting renders offscreen and needs no display.
+    bool exporting = false;
+    for (int i = 1; i < argc; ++i)
+        exporting |= qstrncmp(argv[i], "--export", 8) == 0;
+    if (exporting && !qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
 
-    AnalogClockWindow clock;
-    clock.show();
+    QGuiApplication app(argc, argv);
 
-    return app.exec();
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption parallelOption("parallel", "Rasterize the hands on the thread pool.");
+    QCommandLineOption statsOption("stats", "Print frame statistics on exit.");
+    QCommandLineOption wallOption("wall", "Show <count> clocks tiled in one window.", "count");
+    QCommandLineOption presentOption("present", "Present mode: direct, double or triple.", "mode", "direct");
+    parser.addOption(parallelOption);
+    parser.addOption(statsOption);
+    parser.addOption(wallOption);
+    parser.addOption(presentOption);
+    parser.addOptions({
+        { "export", "Render frames headlessly into <path>: a directory for png and ppm, "
+                    "a file (or - for stdout) for y4m.", "path" },
+        { "format", "Export format: png, ppm or y4m.", "format", "png" },
+        { "size", "Export frame size.", "WxH", "200x200" },
+        { "dpr", "Export device pixel ratio.", "ratio", "1" },
+        { "fps", "Export frame rate.", "fps", "30" },
+        { "frames", "Number of frames to export.", "count", "300" },
+        { "start", "Time shown by the first exported frame.", "hh:mm:ss", "10:08:00" },
+    });
+    parser.process(app);
+
+    if (parser.isSet("export"))
+        return exportFrames(parser);
+
+    QScopedPointer<RasterWindow> clock;
+    if (parser.isSet(wallOption))
+        clock.reset(new ClockWallWindow(qMax(1, parser.value(wallOption).toInt())));
+    else
+        clock.reset(new AnalogClockWindow);
+    clock->setParallelRendering(parser.isSet(parallelOption));
+    const QString present = parser.value(presentOption);
+    if (present == "double")
+        clock->setPresentMode(RasterWindow::DoubleBuffered);
+    else if (present == "triple")
+        clock->setPresentMode(RasterWindow::TripleBuffered);
+    else if (present != "direct")
+        qWarning("Unknown present mode %s", qPrintable(present));
+    clock->show();
+
+    const int result = app.exec();
+
+    if (parser.isSet(statsOption)) {
+        const RasterWindow::FrameStatistics stats = clock->frameStatistics();
+        qInfo("frames %d, missed %d, mean %.2f ms, p99 %.2f ms, render %.2f ms, "
+              "starved buffers %d, starved presents %d, wakeups %.1f/s",
+              stats.frameCount, stats.missedFrames, stats.meanFrameTime,
+              stats.p99FrameTime, stats.meanRenderTime,
+              stats.bufferStarvations, stats.presentStarvations, stats.wakeupsPerSecond);
+    }
+    return result;
 }
@@ -0,0 +1,163 @@
+// spriteasset.cpp
+
+#include "spriteasset.h"
+
+#include <cstring>
+
+static const quint32 kMagic = 0x46535052; // "FSPR"
+static const quint32 kVersion = 1;
+static const int kMaxLevels = 16;
+
+namespace {
+
+struct Header
+{
+    quint32 magic;
+    quint32 version;
+    quint32 levelCount;
+    quint32 reserved;
+};
+
+struct Level
+{
+    quint32 width;
+    quint32 height;
+    quint32 bytesPerLine;
+    quint32 offset;
+};
+
+// Keeps the mapped file (or the bytes read from it) alive for as long as
+// any QImage refers to its pixels.
+struct SpriteData
+{
+    QFile file;
+    QByteArray bytes;
+    const uchar *data = nullptr;
+    qint64 size = 0;
+};
+
+void releaseSpriteData(void *info)
+{
+    delete static_cast<QSharedPointer<SpriteData> *>(info);
+}
+
+qint64 align16(qint64 offset)
+{
+    return (offset + 15) & ~qint64(15);
+}
+
+} // namespace
+
+SpriteAsset SpriteAsset::load(const QString &name)
+{
+    SpriteAsset asset;
+    if (asset.loadFile(QStringLiteral(":/sprites/%1.fspr").arg(name)))
+        return asset;
+
+    QImage image(QStringLiteral(":/images/%1.png").arg(name));
+    if (!image.isNull())
+        asset.m_levels.append(image.convertToFormat(QImage::Format_ARGB32_Premultiplied));
+    return asset;
+}
+
+bool SpriteAsset::loadFile(const QString &fileName)
+{
+    QSharedPointer<SpriteData> sprite(new SpriteData);
+    sprite->file.setFileName(fileName);
+    if (!sprite->file.open(QIODevice::ReadOnly))
+        return false;
+
+    sprite->size = sprite->file.size();
+    // Pixel rows must be 32-bit aligned; resources are not always mapped so.
+    sprite->data = sprite->file.map(0, sprite->size);
+    if (!sprite->data || quintptr(sprite->data) % 4 != 0) {
+        sprite->bytes = sprite->file.readAll();
+        sprite->data = reinterpret_cast<const uchar *>(sprite->bytes.constData());
+        sprite->size = sprite->bytes.size();
+    }
+
+    if (sprite->size < qint64(sizeof(Header)))
+        return false;
+    Header header;
+    memcpy(&header, sprite->data, sizeof(Header));
+    if (header.magic != kMagic || header.version != kVersion)
+        return false;
+    if (header.levelCount < 1 || header.levelCount > quint32(kMaxLevels)
+            || sprite->size < qint64(sizeof(Header) + header.levelCount * sizeof(Level)))
+        return false;
+
+    QList<QImage> levels;
+    for (quint32 i = 0; i < header.levelCount; ++i) {
+        Level level;
+        memcpy(&level, sprite->data + sizeof(Header) + i * sizeof(Level), sizeof(Level));
+        if (level.width == 0 || level.height == 0 || level.bytesPerLine < level.width * 4
+                || level.offset % 16 != 0
+                || qint64(level.offset) + qint64(level.bytesPerLine) * level.height > sprite->size)
+            return false;
+
+        levels.append(QImage(sprite->data + level.offset, int(level.width), int(level.height),
+                             int(level.bytesPerLine), QImage::Format_ARGB32_Premultiplied,
+                             releaseSpriteData, new QSharedPointer<SpriteData>(sprite)));
+    }
+
+    m_levels = levels;
+    return true;
+}
+
+QList<QImage> SpriteAsset::mipChain(const QImage &image, int minimumSize)
+{
+    QList<QImage> levels;
+    QImage level = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    while (!level.isNull() && levels.size() < kMaxLevels) {
+        levels.append(level);
+        if (level.width() / 2 < minimumSize || level.height() / 2 < minimumSize)
+            break;
+        // Smooth scaling by exactly one half averages 2x2 pixel blocks.
+        level = level.scaled(level.width() / 2, level.height() / 2,
+                             Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return levels;
+}
+
+bool SpriteAsset::save(const QString &fileName, const QList<QImage> &levels, bool swapBytes)
+{
+    if (levels.isEmpty() || levels.size() > kMaxLevels)
+        return false;
+
+    auto word = [swapBytes](quint32 value) { return swapBytes ? qbswap(value) : value; };
+
+    QByteArray data;
+    const Header header = { word(kMagic), word(kVersion), word(quint32(levels.size())), 0 };
+    data.append(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    qint64 offset = align16(sizeof(Header) + levels.size() * sizeof(Level));
+    QList<QImage> images;
+    for (const QImage &level : levels) {
+        const QImage image = level.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        const Level entry = { word(quint32(image.width())), word(quint32(image.height())),
+                              word(quint32(image.bytesPerLine())), word(quint32(offset)) };
+        data.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+        offset = align16(offset + image.sizeInBytes());
+        images.append(image);
+    }
+
+    for (const QImage &image : std::as_const(images)) {
+        data.append(QByteArray(align16(data.size()) - data.size(), '\0'));
+        if (!swapBytes) {
+            data.append(reinterpret_cast<const char *>(image.constBits()), image.sizeInBytes());
+            continue;
+        }
+        const quint32 *pixels = reinterpret_cast<const quint32 *>(image.constBits());
+        const qsizetype count = image.sizeInBytes() / 4;
+        for (qsizetype i = 0; i < count; ++i) {
+            const quint32 pixel = qbswap(pixels[i]);
+            data.append(reinterpret_cast<const char *>(&pixel), 4);
+        }
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(data);
+    return file.commit();
+}
@@ -0,0 +1,41 @@
+// spriteasset.h
+
+#ifndef SPRITEASSET_H
+#define SPRITEASSET_H
+
+#include <QtGui>
+
+// A sprite stored pre-decoded in Format_ARGB32_Premultiplied, optionally
+// with a chain of mip levels, each half the size of the previous one.
+//
+// The .fspr file is a small header followed by the raw pixel rows of every
+// level, 16 byte aligned and in the byte order of the machine it was packed
+// for. Loading maps the file (or the uncompressed resource) and wraps the
+// pixels in QImages without decoding or copying them.
+class SpriteAsset
+{
+public:
+    SpriteAsset() = default;
+
+    // Loads ":/sprites/<name>.fspr" as produced by spritepack, or decodes
+    // ":/images/<name>.png" if there is no packed sprite (or it was packed
+    // for the other byte order).
+    static SpriteAsset load(const QString &name);
+
+    bool loadFile(const QString &fileName);
+    static bool save(const QString &fileName, const QList<QImage> &levels, bool swapBytes = false);
+
+    // 'image' followed by successively halved copies, down to the last level
+    // whose sides are both at least 'minimumSize'.
+    static QList<QImage> mipChain(const QImage &image, int minimumSize = 16);
+
+    bool isNull() const { return m_levels.isEmpty(); }
+    QImage image(int level = 0) const { return m_levels.value(level); }
+    QList<QImage> levels() const { return m_levels; }
+    int levelCount() const { return int(m_levels.size()); }
+
+private:
+    QList<QImage> m_levels;
+};
+
+#endif // SPRITEASSET_H
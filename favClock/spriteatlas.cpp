@@ -0,0 +1,187 @@
+// spriteatlas.cpp
+
+#include "spriteatlas.h"
+#include "spriteasset.h"
+#include "spriteblitter.h"
+
+#include <cmath>
+
+// Upper bound for a single atlas. Large windows get fewer angles instead of
+// an unbounded amount of memory, and below kMinAngles the motion would look
+// too jerky, so the hand is drawn transformed instead.
+static const qsizetype kMaxAtlasBytes = 32 * 1024 * 1024;
+static const int kMinAngles = 30;
+
+SpriteAtlas::SpriteAtlas(const QList<QImage> &levels, const QSizeF &size, const QPointF &origin, int angles)
+    : m_levels(levels.size() == 1 ? SpriteAsset::mipChain(levels.first()) : levels)
+    , m_size(size)
+    , m_origin(origin)
+    , m_angles(angles)
+{
+    for (QImage &level : m_levels)
+        level = level.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    selectLevel();
+}
+
+void SpriteAtlas::selectLevel()
+{
+    if (m_levels.isEmpty())
+        return;
+
+    // Before the first prepare() the full size level is used.
+    const QSizeF onScreen = m_size * m_scale * m_devicePixelRatio;
+    m_level = 0;
+    while (m_scale > 0 && m_level + 1 < m_levels.size()
+           && m_levels.at(m_level + 1).width() >= onScreen.width()
+           && m_levels.at(m_level + 1).height() >= onScreen.height())
+        ++m_level;
+
+    const QImage &base = m_levels.first();
+    m_image = m_levels.at(m_level);
+    m_levelOrigin = QPointF(m_origin.x() * m_image.width() / base.width(),
+                            m_origin.y() * m_image.height() / base.height());
+}
+
+QTransform SpriteAtlas::handTransform(qreal angle) const
+{
+    // Same order as the original painter calls: scale(), then rotate().
+    QTransform t;
+    t.scale(m_scale * m_size.width() / m_image.width(),
+            m_scale * m_size.height() / m_image.height());
+    t.rotate(angle);
+    return t;
+}
+
+int SpriteAtlas::frameIndex(qreal angle) const
+{
+    const int count = int(m_frames.size());
+    qreal turns = angle / 360.0;
+    turns -= std::floor(turns);
+    return qRound(turns * count) % count;
+}
+
+void SpriteAtlas::prepare(qreal scale, qreal devicePixelRatio)
+{
+    if (m_levels.isEmpty())
+        return;
+    if (qFuzzyCompare(scale, m_scale) && qFuzzyCompare(devicePixelRatio, m_devicePixelRatio))
+        return;
+
+    m_scale = scale;
+    m_devicePixelRatio = devicePixelRatio;
+    selectLevel();
+
+    for (int angles = m_angles; angles >= kMinAngles; angles /= 2) {
+        if (build(angles))
+            return;
+    }
+
+    m_atlas = QImage();
+    m_frames.clear();
+}
+
+bool SpriteAtlas::build(int angles)
+{
+    QList<Frame> frames(angles);
+    // SpriteBlitter's samples reach a pixel past the image's edges.
+    const QRectF imageRect = QRectF(m_levelOrigin, m_image.size()).adjusted(-1, -1, 1, 1);
+    const QTransform toDevice = QTransform::fromScale(m_devicePixelRatio, m_devicePixelRatio);
+
+    // Shelf packing: frames are placed left to right and a new row starts
+    // when the next one does not fit. The width is chosen to make the atlas
+    // roughly square.
+    qint64 area = 0;
+    int widest = 0;
+    for (int i = 0; i < angles; ++i) {
+        const QTransform t = handTransform(360.0 * i / angles) * toDevice;
+        const QRect bounds = t.mapRect(imageRect).toAlignedRect();
+        frames[i].offset = bounds.topLeft();
+        frames[i].source.setSize(bounds.size());
+        area += qint64(bounds.width()) * bounds.height();
+        widest = qMax(widest, bounds.width());
+    }
+
+    const int atlasWidth = qMax(widest, int(std::ceil(std::sqrt(double(area)))));
+    int x = 0, y = 0, rowHeight = 0;
+    for (Frame &frame : frames) {
+        if (x + frame.source.width() > atlasWidth) {
+            x = 0;
+            y += rowHeight;
+            rowHeight = 0;
+        }
+        frame.source.moveTo(x, y);
+        x += frame.source.width();
+        rowHeight = qMax(rowHeight, frame.source.height());
+    }
+    const int atlasHeight = y + rowHeight;
+
+    if (qint64(atlasWidth) * atlasHeight * 4 > kMaxAtlasBytes)
+        return false;
+
+    QImage atlas(atlasWidth, atlasHeight, QImage::Format_ARGB32_Premultiplied);
+    if (atlas.isNull())
+        return false;
+    atlas.fill(Qt::transparent);
+
+    // The frames are rotated with the same compositor as uncached hands.
+    const QTransform fromImage = QTransform::fromTranslate(m_levelOrigin.x(), m_levelOrigin.y());
+    for (int i = 0; i < angles; ++i) {
+        const Frame &frame = frames.at(i);
+        const QPoint shift = frame.source.topLeft() - frame.offset;
+        SpriteBlitter::blit(&atlas, frame.source, m_image,
+                            fromImage * handTransform(360.0 * i / angles) * toDevice
+                            * QTransform::fromTranslate(shift.x(), shift.y()));
+    }
+
+    atlas.setDevicePixelRatio(m_devicePixelRatio);
+    m_atlas = atlas;
+    m_frames = frames;
+    return true;
+}
+
+void SpriteAtlas::draw(QPainter *painter, const QPointF &center, qreal angle) const
+{
+    const QTransform &base = painter->transform();
+    if (!isCached() || base.type() > QTransform::TxTranslate) {
+        const QTransform spriteToPainter = QTransform::fromTranslate(m_levelOrigin.x(), m_levelOrigin.y())
+                * handTransform(angle) * QTransform::fromTranslate(center.x(), center.y());
+        if (SpriteBlitter::blit(painter, m_image, spriteToPainter))
+            return;
+
+        painter->save();
+        painter->translate(center);
+        painter->setTransform(handTransform(angle), true);
+        painter->setRenderHint(QPainter::SmoothPixmapTransform);
+        painter->drawImage(m_levelOrigin, m_image);
+        painter->restore();
+        return;
+    }
+
+    // Snap the center to a device pixel so the blit is never resampled.
+    const Frame &frame = m_frames.at(frameIndex(angle));
+    const QPointF deviceCenter = base.map(center) * m_devicePixelRatio;
+    const QPoint topLeft = deviceCenter.toPoint() + frame.offset;
+
+    painter->save();
+    painter->resetTransform();
+    painter->drawImage(QPointF(topLeft) / m_devicePixelRatio, m_atlas, QRectF(frame.source));
+    painter->restore();
+}
+
+QRect SpriteAtlas::boundingRect(const QPointF &center, qreal angle) const
+{
+    // The frame draw() blits: the nearest pre-rendered angle, up to half an
+    // angle step away from 'angle', at the snapped center.
+    if (isCached()) {
+        const Frame &frame = m_frames.at(frameIndex(angle));
+        const QPoint topLeft = (center * m_devicePixelRatio).toPoint() + frame.offset;
+        const QRectF deviceRect(topLeft, frame.source.size());
+        return QRectF(deviceRect.topLeft() / m_devicePixelRatio,
+                      deviceRect.size() / m_devicePixelRatio).toAlignedRect();
+    }
+
+    const QRectF imageRect(m_levelOrigin, m_image.size());
+    QRectF bounds = handTransform(angle).mapRect(imageRect).translated(center);
+    // One extra pixel around the edges for antialiasing and center snapping.
+    return bounds.toAlignedRect().adjusted(-1, -1, 1, 1);
+}
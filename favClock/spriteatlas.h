@@ -0,0 +1,77 @@
+// spriteatlas.h
+
+#ifndef SPRITEATLAS_H
+#define SPRITEATLAS_H
+
+#include <QtGui>
+
+// A clock hand image pre-rendered at a fixed number of rotation angles.
+//
+// The hand is described the same way AnalogClockWindow used to draw it:
+// the source image is rotated around the clock center, placed at 'origin'
+// (in image pixels) and scaled to 'size' clock units, where the clock face
+// is 200 units wide. prepare() renders every quantized angle at the current
+// on-screen scale into one packed, premultiplied atlas image with
+// SpriteBlitter, so drawing a hand is a plain untransformed blit.
+//
+// The source is a mip chain (see SpriteAsset::mipChain()); a single image
+// gets one generated. Both the atlas and the transformed fallback sample
+// the smallest level that is still at least as large as the hand on screen,
+// device pixel ratio included.
+class SpriteAtlas
+{
+public:
+    SpriteAtlas() = default;
+    SpriteAtlas(const QList<QImage> &levels, const QSizeF &size, const QPointF &origin, int angles = 120);
+
+    // Rebuilds the atlas if the clock scale (device independent pixels per
+    // clock unit) or the device pixel ratio changed.
+    void prepare(qreal scale, qreal devicePixelRatio);
+
+    // False if the atlas would not fit into the memory budget; draw() then
+    // rotates the hand per frame, with SpriteBlitter where the painter
+    // allows and a transformed drawImage() otherwise.
+    bool isCached() const { return !m_frames.isEmpty(); }
+
+    int angleCount() const { return int(m_frames.size()); }
+    int mipLevel() const { return m_level; }
+    qsizetype byteCount() const { return m_atlas.sizeInBytes(); }
+
+    // Draws the hand rotated by 'angle' degrees around 'center', which is
+    // given in the painter's current (translation only) coordinate system.
+    void draw(QPainter *painter, const QPointF &center, qreal angle) const;
+
+    // Bounding rectangle of what draw() touches, in the same coordinates
+    // with an untransformed painter. For a cached hand that is the frame
+    // of the quantized angle, not the exact one.
+    QRect boundingRect(const QPointF &center, qreal angle) const;
+
+private:
+    struct Frame
+    {
+        QRect source;   // device pixels inside m_atlas
+        QPoint offset;  // device pixels relative to the center
+    };
+
+    QTransform handTransform(qreal angle) const;
+    int frameIndex(qreal angle) const;
+    void selectLevel();
+    bool build(int angles);
+
+    QList<QImage> m_levels;
+    QSizeF m_size;
+    QPointF m_origin;
+    int m_angles = 0;
+
+    // The mip level in use, and the origin scaled to it.
+    int m_level = 0;
+    QImage m_image;
+    QPointF m_levelOrigin;
+
+    qreal m_scale = 0;
+    qreal m_devicePixelRatio = 0;
+    QImage m_atlas;
+    QList<Frame> m_frames;
+};
+
+#endif // SPRITEATLAS_H
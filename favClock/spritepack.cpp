@@ -0,0 +1,53 @@
+// spritepack.cpp
+//
+// Build step for favClock: decodes a PNG once and writes it as a .fspr
+// sprite (see spriteasset.h) that the clock maps at startup.
+
+#include <QtGui>
+
+#include "spriteasset.h"
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Packs an image as a pre-decoded, premultiplied favClock sprite.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Image to pack.");
+    parser.addPositionalArgument("output", "The .fspr file to write.");
+    QCommandLineOption mipsOption("mips", "Also store halved mip levels.");
+    QCommandLineOption byteOrderOption("byte-order", "Byte order of the target: little or big.",
+                                       "order", QSysInfo::ByteOrder == QSysInfo::BigEndian ? "big" : "little");
+    parser.addOption(mipsOption);
+    parser.addOption(byteOrderOption);
+    parser.process(app);
+
+    const QStringList arguments = parser.positionalArguments();
+    if (arguments.size() != 2)
+        parser.showHelp(1);
+
+    QImage image(arguments.at(0));
+    if (image.isNull()) {
+        qWarning("spritepack: cannot read %s", qPrintable(arguments.at(0)));
+        return 1;
+    }
+
+    const QString byteOrder = parser.value(byteOrderOption);
+    if (byteOrder != "little" && byteOrder != "big") {
+        qWarning("spritepack: unknown byte order %s", qPrintable(byteOrder));
+        return 1;
+    }
+    const bool targetBigEndian = byteOrder == "big";
+    const bool swapBytes = targetBigEndian != (QSysInfo::ByteOrder == QSysInfo::BigEndian);
+
+    const QList<QImage> levels = parser.isSet(mipsOption)
+            ? SpriteAsset::mipChain(image)
+            : QList<QImage>{ image.convertToFormat(QImage::Format_ARGB32_Premultiplied) };
+
+    if (!SpriteAsset::save(arguments.at(1), levels, swapBytes)) {
+        qWarning("spritepack: cannot write %s", qPrintable(arguments.at(1)));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+# Packs favClock's hand images into pre-decoded .fspr sprites at build time
+# and adds them, uncompressed so they can be mapped, as the ":/sprites"
+# resource of a target. Without them (cross builds, qmake builds) the clock
+# decodes the PNGs from favClock.qrc instead.
+
+set(FAVCLOCK_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+function(favclock_add_sprites target)
+    if(CMAKE_CROSSCOMPILING)
+        return()
+    endif()
+
+    if(NOT TARGET spritepack)
+        qt_add_executable(spritepack
+            ${FAVCLOCK_DIR}/spriteasset.cpp ${FAVCLOCK_DIR}/spriteasset.h
+            ${FAVCLOCK_DIR}/spritepack.cpp
+        )
+        target_link_libraries(spritepack PRIVATE
+            Qt::Core
+            Qt::Gui
+        )
+    endif()
+
+    set(sprite_dir ${CMAKE_CURRENT_BINARY_DIR}/sprites)
+    set(sprite_files)
+    foreach(sprite boing01 pingu01 scream01)
+        add_custom_command(OUTPUT ${sprite_dir}/${sprite}.fspr
+            COMMAND ${CMAKE_COMMAND} -E make_directory ${sprite_dir}
+            COMMAND spritepack --mips ${FAVCLOCK_DIR}/images/${sprite}.png ${sprite_dir}/${sprite}.fspr
+            DEPENDS spritepack ${FAVCLOCK_DIR}/images/${sprite}.png
+            VERBATIM
+        )
+        list(APPEND sprite_files ${sprite_dir}/${sprite}.fspr)
+    endforeach()
+
+    qt_add_resources(${target} "sprites"
+        PREFIX "/sprites"
+        BASE ${sprite_dir}
+        FILES ${sprite_files}
+        OPTIONS --no-compress
+    )
+endfunction()
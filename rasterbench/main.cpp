@@ -0,0 +1,554 @@
+// rasterbench
+//
+// Renders RasterWindow subclasses into offscreen images and reports the cost
+// per frame as JSON, along with a per hand comparison of SpriteBlitter and
+// QPainter's transformed drawImage(): time and difference of the output.
+// On a small face it also compares drawing each hand from its full image and
+// from the mip level SpriteAtlas picks, against a supersampled reference,
+// and times drawing each hand from its SpriteAtlas against drawing it
+// transformed.
+// Exits with 1 if an implementation's pixels differ from the scalar one's,
+// or an RGB32 target's from a premultiplied one's.
+// Runs without a display: unless QT_QPA_PLATFORM says otherwise, the
+// offscreen platform plugin is used.
+
+#include <QtGui>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "analogclockwindow.h"
+#include "clockwallwindow.h"
+#include "spriteasset.h"
+#include "spriteatlas.h"
+#include "spriteblitter.h"
+
+// Allocations are counted while a measurement runs. On glibc malloc itself
+// is wrapped, which also catches image data and other C allocations made by
+// Qt; elsewhere only operator new is seen.
+static std::atomic<bool> countAllocations(false);
+static std::atomic<qint64> allocationCount(0);
+static std::atomic<qint64> allocatedBytes(0);
+
+static inline void recordAllocation(size_t size)
+{
+    if (countAllocations.load(std::memory_order_relaxed)) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(qint64(size), std::memory_order_relaxed);
+    }
+}
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) noexcept
+{
+    recordAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept
+{
+    recordAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept
+{
+    recordAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+}
+#else
+void *operator new(std::size_t size)
+{
+    recordAllocation(size);
+    if (void *ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+struct Configuration
+{
+    QSize size;
+    qreal devicePixelRatio;
+};
+
+static const Configuration configurations[] = {
+    { QSize(200, 200), 1 },
+    { QSize(200, 200), 2 },
+    { QSize(800, 800), 1 },
+    { QSize(800, 800), 2 },
+    { QSize(1920, 1080), 1 },
+    { QSize(1920, 1080), 2 },
+    { QSize(3840, 2160), 1 },
+};
+
+// The dashboard wall: this many clocks tiled into one window.
+static const int kWallClocks = 200;
+static const Configuration wallConfigurations[] = {
+    { QSize(1920, 1080), 1 },
+    { QSize(3840, 2160), 1 },
+};
+
+// Frames rendered before measuring, so caches are built and warm.
+static const int kWarmupFrames = 20;
+
+static qint64 area(const QRegion &region)
+{
+    qint64 pixels = 0;
+    for (const QRect &rect : region)
+        pixels += qint64(rect.width()) * rect.height();
+    return pixels;
+}
+
+// Frames advance the animation by this much virtual time, so every run
+// renders the same frames whatever the machine's speed.
+static const qint64 kFrameInterval = 1000000000 / 60;
+
+// 'startup' was started before the window was constructed.
+static QJsonObject measure(RasterWindow *window, AnimationClock *clock, const Configuration &config,
+                           int frames, const QElapsedTimer &startup)
+{
+    AnimationClock::VirtualTimeSource *time = new AnimationClock::VirtualTimeSource;
+    clock->setTimeSource(time);
+    clock->setStartTime(QTime(10, 8, 0));
+    auto renderFrame = [&](QImage *image) {
+        time->advance(kFrameInterval);
+        return window->renderTo(image);
+    };
+
+    window->resize(config.size);
+
+    QImage image(config.size * config.devicePixelRatio, QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(config.devicePixelRatio);
+
+    renderFrame(&image);
+    const qint64 firstFrame = startup.nsecsElapsed();
+    for (int i = 1; i < kWarmupFrames; ++i)
+        renderFrame(&image);
+
+    qint64 damagedPixels = 0;
+    allocationCount = 0;
+    allocatedBytes = 0;
+
+    QElapsedTimer timer;
+    countAllocations = true;
+    timer.start();
+    for (int i = 0; i < frames; ++i)
+        damagedPixels += area(renderFrame(&image));
+    const qint64 elapsed = timer.nsecsElapsed();
+    countAllocations = false;
+
+    const qreal dpr2 = config.devicePixelRatio * config.devicePixelRatio;
+    const qreal devicePixels = damagedPixels * dpr2;
+
+    QJsonObject result;
+    result["width"] = config.size.width();
+    result["height"] = config.size.height();
+    result["devicePixelRatio"] = config.devicePixelRatio;
+    result["frames"] = frames;
+    result["timeToFirstFrameNs"] = double(firstFrame);
+    result["nsPerFrame"] = double(elapsed) / frames;
+    result["allocationsPerFrame"] = double(allocationCount) / frames;
+    result["bytesAllocatedPerFrame"] = double(allocatedBytes) / frames;
+    result["damagedPixelsPerFrame"] = devicePixels / frames;
+    result["pixelsPerSecond"] = elapsed > 0 ? devicePixels * 1e9 / elapsed : 0.0;
+    return result;
+}
+
+// The hands as ClockSprites lays them out: clock units on a face 200 units
+// wide, and the rotation center in image pixels.
+struct Hand
+{
+    const char *name;
+    QSizeF size;
+    QPointF origin;
+};
+
+static const Hand hands[] = {
+    { "boing01", QSizeF(150, 150), QPointF(-375, -375) },
+    { "pingu01", QSizeF(40, 100), QPointF(-120, -685) },
+    { "scream01", QSizeF(40, 80), QPointF(-170, -650) },
+};
+
+// Face size in pixels the hands are drawn for, and angles per measurement.
+static const int kHandFace = 800;
+static const int kHandAngles = 360;
+
+// Maps the sprite's pixels onto a 'face' pixel face, rotated by 'angle'.
+static QTransform handTransform(const Hand &hand, const QImage &level, const QImage &base, qreal angle,
+                                int face = kHandFace)
+{
+    const qreal scale = face / 200.0;
+    const QPointF origin(hand.origin.x() * level.width() / base.width(),
+                         hand.origin.y() * level.height() / base.height());
+    QTransform t = QTransform::fromTranslate(origin.x(), origin.y());
+    t *= QTransform::fromScale(scale * hand.size.width() / level.width(),
+                               scale * hand.size.height() / level.height());
+    t *= QTransform().rotate(angle);
+    t *= QTransform::fromTranslate(face / 2.0, face / 2.0);
+    return t;
+}
+
+// The smallest level still as large as the hand on a 'face' pixel face.
+static int levelFor(const QList<QImage> &levels, const Hand &hand, int face)
+{
+    const QSizeF onScreen = hand.size * (face / 200.0);
+    int level = 0;
+    while (level + 1 < levels.size() && levels.at(level + 1).width() >= onScreen.width()
+           && levels.at(level + 1).height() >= onScreen.height())
+        ++level;
+    return level;
+}
+
+// Same size and same bytes, whatever the formats say.
+static bool samePixels(const QImage &a, const QImage &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (int y = 0; y < a.height(); ++y) {
+        if (memcmp(a.constScanLine(y), b.constScanLine(y), size_t(a.width()) * 4) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Compares the blitter's output against QPainter's smooth transformed
+// drawImage() on the same background, and times both per drawn hand. Every
+// implementation must give the scalar one's pixels, on a premultiplied and
+// on an RGB32 target alike; 'ok' is cleared if one does not. The difference
+// from QPainter, which rounds differently, is only reported.
+static QJsonArray measureHands(int frames, bool *ok)
+{
+    QImage background(kHandFace, kHandFace, QImage::Format_ARGB32_Premultiplied);
+    {
+        QPainter p(&background);
+        p.fillRect(background.rect(), QGradient::NightFade);
+    }
+    const QImage opaqueBackground = background.convertToFormat(QImage::Format_RGB32);
+
+    QJsonArray results;
+    for (const Hand &hand : hands) {
+        const QList<QImage> levels = SpriteAsset::mipChain(SpriteAsset::load(hand.name).image());
+        if (levels.isEmpty())
+            continue;
+        const QImage sprite = levels.at(levelFor(levels, hand, kHandFace));
+
+        auto drawWithPainter = [&](QImage *target, qreal angle) {
+            QPainter p(target);
+            p.setRenderHint(QPainter::SmoothPixmapTransform);
+            p.setTransform(handTransform(hand, sprite, levels.first(), angle));
+            p.drawImage(0, 0, sprite);
+        };
+
+        const int iterations = qMax(kHandAngles, frames);
+        auto time = [&](auto draw) {
+            QImage target = background.copy();
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < iterations; ++i)
+                draw(&target, 360.0 * (i % kHandAngles) / kHandAngles);
+            return double(timer.nsecsElapsed()) / iterations;
+        };
+
+        const double painterNs = time(drawWithPainter);
+
+        for (int i = SpriteBlitter::Scalar; i <= SpriteBlitter::Avx2; ++i) {
+            const auto implementation = SpriteBlitter::Implementation(i);
+            if (!SpriteBlitter::isSupported(implementation))
+                continue;
+            auto drawWithBlitter = [&](QImage *target, qreal angle, SpriteBlitter::Implementation with) {
+                SpriteBlitter::blit(target, target->rect(), sprite,
+                                    handTransform(hand, sprite, levels.first(), angle), with);
+            };
+
+            int maxDifference = 0;
+            qint64 totalDifference = 0;
+            qint64 channels = 0;
+            bool exact = true;
+            for (int angle = 0; angle < 360; angle += 15) {
+                QImage expected = background.copy();
+                QImage actual = background.copy();
+                drawWithPainter(&expected, angle);
+                drawWithBlitter(&actual, angle, implementation);
+
+                for (int y = 0; y < expected.height(); ++y) {
+                    const uchar *e = expected.constScanLine(y);
+                    const uchar *a = actual.constScanLine(y);
+                    for (int x = 0; x < expected.width() * 4; ++x) {
+                        const int difference = qAbs(int(e[x]) - int(a[x]));
+                        maxDifference = qMax(maxDifference, difference);
+                        totalDifference += difference;
+                    }
+                }
+                channels += qint64(expected.width()) * expected.height() * 4;
+
+                QImage scalar = background.copy();
+                drawWithBlitter(&scalar, angle, SpriteBlitter::Scalar);
+                QImage opaque = opaqueBackground.copy();
+                drawWithBlitter(&opaque, angle, implementation);
+                const char *mismatch = !samePixels(actual, scalar) ? "the scalar implementation"
+                        : !samePixels(opaque, scalar) ? "itself on an RGB32 target" : nullptr;
+                if (mismatch) {
+                    qWarning("%s, %s, %d degrees: differs from %s",
+                             hand.name, SpriteBlitter::name(implementation), angle, mismatch);
+                    exact = false;
+                    *ok = false;
+                }
+            }
+
+            const double blitterNs = time([&](QImage *target, qreal angle) {
+                drawWithBlitter(target, angle, implementation);
+            });
+
+            QJsonObject result;
+            result["sprite"] = hand.name;
+            result["implementation"] = SpriteBlitter::name(implementation);
+            result["faceSize"] = kHandFace;
+            result["spriteWidth"] = sprite.width();
+            result["spriteHeight"] = sprite.height();
+            result["qpainterNsPerHand"] = painterNs;
+            result["blitterNsPerHand"] = blitterNs;
+            result["speedup"] = blitterNs > 0 ? painterNs / blitterNs : 0.0;
+            result["maxChannelDifference"] = maxDifference;
+            result["meanChannelDifference"] = double(totalDifference) / channels;
+            result["matchesScalar"] = exact;
+            results.append(result);
+        }
+    }
+    return results;
+}
+
+// Face size in pixels the mip levels are compared at, small enough that
+// every hand picks a level below the full image, and the supersampling
+// factor of the reference they are compared against.
+static const int kMipFace = 200;
+static const int kMipSupersampling = 4;
+static const int kMipAngles = 24;
+
+// Draws each hand on a kMipFace face from the full image and from the level
+// SpriteAtlas would pick, and reports the time of each and their mean
+// difference from the full image drawn kMipSupersampling times larger and
+// scaled down, over the pixels the hand covers.
+static QJsonArray measureMipLevels(int frames)
+{
+    // The background is scaled down the same way as the references, so the
+    // pixels the hand leaves alone match.
+    const int largeFace = kMipFace * kMipSupersampling;
+    QImage largeBackground(largeFace, largeFace, QImage::Format_RGB32);
+    {
+        QPainter p(&largeBackground);
+        p.fillRect(largeBackground.rect(), QGradient::NightFade);
+    }
+    const QImage background = largeBackground.scaled(kMipFace, kMipFace, Qt::IgnoreAspectRatio,
+                                                     Qt::SmoothTransformation);
+    const SpriteBlitter::Implementation implementation = SpriteBlitter::bestImplementation();
+
+    QJsonArray results;
+    for (const Hand &hand : hands) {
+        const QList<QImage> levels = SpriteAsset::mipChain(SpriteAsset::load(hand.name).image());
+        if (levels.isEmpty())
+            continue;
+        const QImage &base = levels.first();
+        const int level = levelFor(levels, hand, kMipFace);
+
+        QList<QImage> references;
+        for (int i = 0; i < kMipAngles; ++i) {
+            QImage large = largeBackground.copy();
+            SpriteBlitter::blit(&large, large.rect(), base,
+                                handTransform(hand, base, base, 360.0 * i / kMipAngles, largeFace), implementation);
+            references.append(large.scaled(kMipFace, kMipFace, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+        }
+
+        QJsonObject result;
+        result["sprite"] = hand.name;
+        result["implementation"] = SpriteBlitter::name(implementation);
+        result["faceSize"] = kMipFace;
+        result["level"] = level;
+        for (bool mip : { false, true }) {
+            const QImage &sprite = levels.at(mip ? level : 0);
+            auto draw = [&](QImage *target, qreal angle) {
+                SpriteBlitter::blit(target, target->rect(), sprite,
+                                    handTransform(hand, sprite, base, angle, kMipFace), implementation);
+            };
+
+            qint64 totalDifference = 0;
+            qint64 channels = 0;
+            for (int i = 0; i < kMipAngles; ++i) {
+                QImage actual = background.copy();
+                draw(&actual, 360.0 * i / kMipAngles);
+                const QImage &expected = references.at(i);
+                for (int y = 0; y < actual.height(); ++y) {
+                    const QRgb *a = reinterpret_cast<const QRgb *>(actual.constScanLine(y));
+                    const QRgb *e = reinterpret_cast<const QRgb *>(expected.constScanLine(y));
+                    const QRgb *b = reinterpret_cast<const QRgb *>(background.constScanLine(y));
+                    for (int x = 0; x < actual.width(); ++x) {
+                        if (a[x] == b[x] && e[x] == b[x])
+                            continue;
+                        totalDifference += qAbs(qRed(a[x]) - qRed(e[x])) + qAbs(qGreen(a[x]) - qGreen(e[x]))
+                                + qAbs(qBlue(a[x]) - qBlue(e[x]));
+                        channels += 3;
+                    }
+                }
+            }
+
+            const int iterations = qMax(kHandAngles, frames);
+            QImage target = background.copy();
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < iterations; ++i)
+                draw(&target, 360.0 * (i % kHandAngles) / kHandAngles);
+            const double ns = double(timer.nsecsElapsed()) / iterations;
+
+            const QString prefix = mip ? QStringLiteral("level") : QStringLiteral("fullImage");
+            result[prefix + "Width"] = sprite.width();
+            result[prefix + "Height"] = sprite.height();
+            result[prefix + "NsPerHand"] = ns;
+            result[prefix + "MeanDifference"] = channels ? double(totalDifference) / channels : 0.0;
+        }
+        results.append(result);
+    }
+    return results;
+}
+
+// Face sizes in pixels the hand atlases are measured at.
+static const int atlasFaces[] = { 200, 800 };
+
+// Times building each hand's atlas and drawing the hand from it, against
+// drawing it transformed per frame, as SpriteAtlas does when it has no
+// atlas, on the same RGB32 target.
+static QJsonArray measureAtlases(int frames)
+{
+    QJsonArray results;
+    for (int face : atlasFaces) {
+        QImage background(face, face, QImage::Format_RGB32);
+        {
+            QPainter p(&background);
+            p.fillRect(background.rect(), QGradient::NightFade);
+        }
+        const QPointF center(face / 2.0, face / 2.0);
+
+        for (const Hand &hand : hands) {
+            const QList<QImage> levels = SpriteAsset::load(hand.name).levels();
+            if (levels.isEmpty())
+                continue;
+            SpriteAtlas cached(levels, hand.size, hand.origin);
+            SpriteAtlas transformed(levels, hand.size, hand.origin, 0);
+
+            QElapsedTimer timer;
+            timer.start();
+            cached.prepare(face / 200.0, 1);
+            const qint64 prepareTime = timer.nsecsElapsed();
+            transformed.prepare(face / 200.0, 1);
+
+            const int iterations = qMax(kHandAngles, frames);
+            auto time = [&](const SpriteAtlas &atlas) {
+                QImage target = background.copy();
+                QPainter p(&target);
+                QElapsedTimer drawTimer;
+                drawTimer.start();
+                for (int i = 0; i < iterations; ++i)
+                    atlas.draw(&p, center, 360.0 * (i % kHandAngles) / kHandAngles);
+                return double(drawTimer.nsecsElapsed()) / iterations;
+            };
+
+            QJsonObject result;
+            result["sprite"] = hand.name;
+            result["faceSize"] = face;
+            result["cached"] = cached.isCached();
+            result["angles"] = cached.angleCount();
+            result["atlasBytes"] = double(cached.byteCount());
+            result["prepareNs"] = double(prepareTime);
+            result["atlasNsPerHand"] = time(cached);
+            result["transformedNsPerHand"] = time(transformed);
+            results.append(result);
+        }
+    }
+    return results;
+}
+
+int main(int argc, char **argv)
+{
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Offscreen rendering benchmark for RasterWindow subclasses.");
+    parser.addHelpOption();
+    QCommandLineOption framesOption("frames", "Frames to measure per configuration.", "count", "2000");
+    QCommandLineOption outputOption({ "o", "output" }, "Write the JSON report to <file>.", "file");
+    QCommandLineOption parallelOption("parallel", "Rasterize layers on the thread pool.");
+    parser.addOption(framesOption);
+    parser.addOption(outputOption);
+    parser.addOption(parallelOption);
+    parser.process(app);
+
+    const int frames = qMax(1, parser.value(framesOption).toInt());
+
+    QJsonArray results;
+    for (const Configuration &config : configurations) {
+        QElapsedTimer startup;
+        startup.start();
+        AnalogClockWindow window;
+        window.setAnimating(false);
+        window.setParallelRendering(parser.isSet(parallelOption));
+        QJsonObject result = measure(&window, window.animationClock(), config, frames, startup);
+        result["window"] = "AnalogClockWindow";
+        results.append(result);
+    }
+    for (const Configuration &config : wallConfigurations) {
+        QElapsedTimer startup;
+        startup.start();
+        ClockWallWindow window(kWallClocks);
+        window.setAnimating(false);
+        window.setParallelRendering(parser.isSet(parallelOption));
+        QJsonObject result = measure(&window, window.animationClock(), config, frames, startup);
+        result["window"] = "ClockWallWindow";
+        result["clocks"] = kWallClocks;
+        results.append(result);
+    }
+
+    QJsonObject report;
+    report["benchmark"] = "rasterbench";
+    report["parallel"] = parser.isSet(parallelOption);
+    report["results"] = results;
+    bool handsOk = true;
+    report["hands"] = measureHands(frames, &handsOk);
+    report["handsOk"] = handsOk;
+    report["mipLevels"] = measureMipLevels(frames);
+    report["atlases"] = measureAtlases(frames);
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (!parser.isSet(outputOption)) {
+        fwrite(json.constData(), 1, json.size(), stdout);
+        return handsOk ? 0 : 1;
+    }
+
+    QFile file(parser.value(outputOption));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning("Cannot write %s: %s", qPrintable(file.fileName()), qPrintable(file.errorString()));
+        return 1;
+    }
+    file.write(json);
+    return handsOk ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+include(../rasterwindow/rasterwindow.pri)
+
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../favClock
+
+SOURCES += \
+    ../favClock/analogclockwindow.cpp \
+    ../favClock/animationclock.cpp \
+    ../favClock/clockface.cpp \
+    ../favClock/clockwallwindow.cpp \
+    ../favClock/spriteasset.cpp \
+    ../favClock/spriteatlas.cpp \
+    main.cpp
+
+HEADERS += \
+    ../favClock/analogclockwindow.h \
+    ../favClock/animationclock.h \
+    ../favClock/clockface.h \
+    ../favClock/clockwallwindow.h \
+    ../favClock/spriteasset.h \
+    ../favClock/spriteatlas.h
+
+RESOURCES = ../favClock/favClock.qrc
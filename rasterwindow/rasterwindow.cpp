@@ -50,23 +50,55 @@
 
 #include "rasterwindow.h"
 
+#include <algorithm>
+
+// Number of recent frames the statistics are computed over.
+static const int kFrameHistory = 240;
+// Period wakeups per second are averaged over, in nanoseconds.
+static const qint64 kWakeupWindow = 5000000000LL;
+
 //! [1]
 RasterWindow::RasterWindow(QWindow *parent)
     : QWindow(parent)
     , m_backingStore(new QBackingStore(this))
+    , m_scene(new SceneLayer(this, nullptr))
 {
     setGeometry(100, 100, 300, 200);
+
+    m_frameTimer.setSingleShot(true);
+    m_frameTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_frameTimer, &QTimer::timeout, this, [this] {
+        recordWakeup();
+        requestUpdate();
+    });
+    connect(this, &QWindow::visibilityChanged, this, &RasterWindow::updateSuspended);
+    m_clock.start();
 }
 //! [1]
 
+RasterWindow::~RasterWindow()
+{
+    stopRenderThread();
+}
+
 
 //! [7]
 bool RasterWindow::event(QEvent *event)
 {
     if (event->type() == QEvent::UpdateRequest) {
+        recordWakeup();
         renderNow();
         return true;
     }
+    if (event->type() == QEvent::ThemeChange) {
+        invalidateBackground();
+        renderLater();
+    }
+    if (event->type() == QEvent::PlatformSurface
+            && static_cast<QPlatformSurfaceEvent *>(event)->surfaceEventType()
+                == QPlatformSurfaceEvent::SurfaceAboutToBeDestroyed) {
+        stopRendering();
+    }
     return QWindow::event(event);
 }
 //! [7]
@@ -83,42 +115,562 @@ void RasterWindow::renderLater()
 void RasterWindow::resizeEvent(QResizeEvent *resizeEvent)
 {
     m_backingStore->resize(resizeEvent->size());
+    invalidateBackground();
 }
 //! [5]
 
 //! [2]
 void RasterWindow::exposeEvent(QExposeEvent *)
 {
-    if (isExposed())
+    updateSuspended();
+    if (isExposed() && !m_suspended) {
+        invalidate();
         renderNow();
+    }
 }
 //! [2]
 
+void RasterWindow::updateSuspended()
+{
+    const QWindow::Visibility state = visibility();
+    const bool suspended = !isExposed() || state == QWindow::Hidden || state == QWindow::Minimized;
+    if (suspended == m_suspended)
+        return;
+
+    m_suspended = suspended;
+    if (suspended) {
+        // Paused; the gap until the next frame is not a missed frame.
+        m_frameTimer.stop();
+        m_lastFrameStart = -1;
+        waitForRenderThread();
+    } else {
+        invalidate();
+        renderLater();
+    }
+}
+
+void RasterWindow::recordWakeup()
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    m_wakeups.append(now);
+    while (m_wakeups.first() < now - kWakeupWindow)
+        m_wakeups.removeFirst();
+}
+
 
 //! [3]
 void RasterWindow::renderNow()
 {
-    if (!isExposed())
+    if (!isExposed() || m_suspended)
+        return;
+
+    if (m_presentMode != DirectPresent) {
+        if (!m_renderThread)
+            startRenderThread();
+        presentFrame(true);
+        return;
+    }
+
+    const qint64 frameStart = m_clock.nsecsElapsed();
+
+    m_targetSize = size();
+    m_targetDevicePixelRatio = devicePixelRatio();
+    const QRegion region = nextDamage();
+    if (region.isEmpty()) {
+        m_lastFrameStart = -1;
+        scheduleNextFrame(frameStart, true);
         return;
+    }
 
-    QRect rect(0, 0, width(), height());
-    m_backingStore->beginPaint(rect);
+    m_backingStore->beginPaint(region);
 
     QPaintDevice *device = m_backingStore->paintDevice();
     QPainter painter(device);
-
-    painter.fillRect(0, 0, width(), height(), QGradient::NightFade);
-    render(&painter);
+    paintFrame(&painter, region);
     painter.end();
 
     m_backingStore->endPaint();
-    m_backingStore->flush(rect);
+    m_backingStore->flush(region);
+
+    recordFrame(frameStart, m_clock.nsecsElapsed());
+    scheduleNextFrame(frameStart, false);
 }
 //! [3]
 
+QRegion RasterWindow::renderTo(QPaintDevice *device)
+{
+    waitForRenderThread();
+
+    const QSize deviceSize(device->width(), device->height());
+    if (deviceSize != m_lastDeviceSize) {
+        m_lastDeviceSize = deviceSize;
+        invalidateBackground();
+    }
+
+    m_targetSize = size();
+    m_targetDevicePixelRatio = device->devicePixelRatio();
+    const QRegion region = nextDamage();
+    if (region.isEmpty())
+        return region;
+
+    QPainter painter(device);
+    paintFrame(&painter, region);
+
+    // The frame buffers did not see this frame's changes.
+    for (FrameBuffer &buffer : m_buffers)
+        buffer.stale += region;
+    return region;
+}
+
+QRegion RasterWindow::nextDamage()
+{
+    const QRect rect(QPoint(), m_targetSize);
+    // Scene changes made from damagedRegion() belong to this frame.
+    m_updatingFrame = true;
+    QRegion region = damagedRegion();
+    m_updatingFrame = false;
+    m_scene->updateState(false, &region);
+    if (m_fullRepaint.exchange(false))
+        region = rect;
+    return region & rect;
+}
+
+void RasterWindow::paintFrame(QPainter *painter, const QRegion &region)
+{
+    // The background is laid out relative to the whole window, so it is
+    // clipped rather than drawn per damaged rectangle.
+    painter->setClipRegion(region);
+    paintBackground(painter);
+    if (m_parallelRendering && layerCount() > 1)
+        paintLayers(painter, region);
+    else
+        render(painter);
+    m_scene->paint(painter, region.boundingRect());
+}
+
+QRegion RasterWindow::damagedRegion()
+{
+    return QRegion(QRect(QPoint(), m_targetSize));
+}
+
+void RasterWindow::invalidate()
+{
+    m_fullRepaint = true;
+}
+
+void RasterWindow::setAnimating(bool animating)
+{
+    if (m_animating == animating)
+        return;
+
+    m_animating = animating;
+    m_lastFrameStart = -1;
+    if (animating)
+        renderLater();
+    else
+        m_frameTimer.stop();
+}
+
+void RasterWindow::setTargetFrameRate(qreal fps)
+{
+    m_targetFrameRate = qMax<qreal>(0, fps);
+}
+
+void RasterWindow::setIdleFrameRate(qreal fps)
+{
+    m_idleFrameRate = qMax<qreal>(0.1, fps);
+}
+
+qreal RasterWindow::refreshRate() const
+{
+    return screen() && screen()->refreshRate() > 0 ? screen()->refreshRate() : 60.0;
+}
+
+qint64 RasterWindow::frameInterval(bool idle) const
+{
+    qreal fps = refreshRate();
+    if (idle)
+        fps = qMin(fps, m_idleFrameRate);
+    else if (m_targetFrameRate > 0)
+        fps = qMin(fps, m_targetFrameRate);
+    return qint64(1e9 / fps);
+}
+
+void RasterWindow::scheduleNextFrame(qint64 frameStart, bool idle)
+{
+    if (!m_animating || m_suspended)
+        return;
+
+    // requestUpdate() delivers the next frame on the following vsync. When
+    // the target interval spans several refresh cycles, wait with a timer
+    // first and ask for the update one cycle ahead of the deadline.
+    const qint64 refresh = qint64(1e9 / refreshRate());
+    const qint64 deadline = frameStart + frameInterval(idle);
+    const qint64 wait = deadline - m_clock.nsecsElapsed() - refresh;
+    if (wait < refresh / 2)
+        requestUpdate();
+    else
+        m_frameTimer.start(int(wait / 1000000));
+}
+
+void RasterWindow::recordFrame(qint64 start, qint64 end)
+{
+    if (m_animating && m_lastFrameStart >= 0) {
+        const qint64 interval = start - m_lastFrameStart;
+        if (interval > frameInterval(false) * 3 / 2)
+            ++m_missedFrames;
+        ++m_frameCount;
+        m_frameTimes.append(interval);
+        m_renderTimes.append(end - start);
+        if (m_frameTimes.size() > kFrameHistory) {
+            m_frameTimes.removeFirst();
+            m_renderTimes.removeFirst();
+        }
+    }
+    m_lastFrameStart = m_animating ? start : -1;
+}
+
+RasterWindow::FrameStatistics RasterWindow::frameStatistics() const
+{
+    FrameStatistics stats;
+    stats.frameCount = m_frameCount;
+    stats.missedFrames = m_missedFrames;
+
+    // Wakeups stop being recorded while suspended, so only count recent ones.
+    const qint64 now = m_clock.nsecsElapsed();
+    const auto recent = std::upper_bound(m_wakeups.cbegin(), m_wakeups.cend(), now - kWakeupWindow);
+    const qint64 window = qMin(now, kWakeupWindow);
+    if (window > 0)
+        stats.wakeupsPerSecond = (m_wakeups.cend() - recent) * 1e9 / window;
+
+    {
+        QMutexLocker locker(&m_bufferMutex);
+        stats.bufferStarvations = m_bufferStarvations;
+        stats.presentStarvations = m_presentStarvations;
+    }
+    if (m_frameTimes.isEmpty())
+        return stats;
+
+    qint64 frameTotal = 0;
+    qint64 renderTotal = 0;
+    for (int i = 0; i < m_frameTimes.size(); ++i) {
+        frameTotal += m_frameTimes.at(i);
+        renderTotal += m_renderTimes.at(i);
+    }
+    stats.meanFrameTime = frameTotal / 1e6 / m_frameTimes.size();
+    stats.meanRenderTime = renderTotal / 1e6 / m_renderTimes.size();
+
+    QList<qint64> sorted = m_frameTimes;
+    auto p99 = sorted.begin() + (sorted.size() - 1) * 99 / 100;
+    std::nth_element(sorted.begin(), p99, sorted.end());
+    stats.p99FrameTime = *p99 / 1e6;
+    return stats;
+}
+
+void RasterWindow::resetFrameStatistics()
+{
+    m_frameCount = 0;
+    m_missedFrames = 0;
+    {
+        QMutexLocker locker(&m_bufferMutex);
+        m_bufferStarvations = 0;
+        m_presentStarvations = 0;
+    }
+    m_frameTimes.clear();
+    m_renderTimes.clear();
+    m_wakeups.clear();
+}
+
+int RasterWindow::layerCount() const
+{
+    return 0;
+}
+
+void RasterWindow::renderLayer(int, QPainter *)
+{
+}
+
+// The render thread reads the flag each frame; the layer images are only
+// dropped once the frame in flight is done with them. That also cancels
+// the frame requested next, so another one is asked for.
+void RasterWindow::setParallelRendering(bool parallel)
+{
+    waitForRenderThread();
+    m_parallelRendering = parallel;
+    if (!parallel)
+        m_layers.clear();
+    renderLater();
+}
+
+void RasterWindow::paintLayers(QPainter *painter, const QRegion &region)
+{
+    const int count = layerCount();
+    const qreal dpr = painter->device()->devicePixelRatio();
+    const QSize pixelSize = m_targetSize * dpr;
+
+    m_layers.resize(count);
+    for (QImage &layer : m_layers) {
+        if (layer.size() != pixelSize || layer.devicePixelRatio() != dpr) {
+            layer = QImage(pixelSize, QImage::Format_ARGB32_Premultiplied);
+            layer.setDevicePixelRatio(dpr);
+        }
+    }
+
+    // Each layer only clears and redraws the damaged region of its image.
+    QImage *layers = m_layers.data();
+    auto rasterize = [this, layers, &region](int index) {
+        QPainter layerPainter(&layers[index]);
+        layerPainter.setClipRegion(region);
+        layerPainter.setCompositionMode(QPainter::CompositionMode_Source);
+        layerPainter.fillRect(region.boundingRect(), Qt::transparent);
+        layerPainter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+        renderLayer(index, &layerPainter);
+    };
+
+    // The GUI thread takes the last layer itself instead of idling.
+    QSemaphore done;
+    for (int i = 0; i < count - 1; ++i) {
+        QThreadPool::globalInstance()->start([&rasterize, &done, i] {
+            rasterize(i);
+            done.release();
+        });
+    }
+    rasterize(count - 1);
+    done.acquire(count - 1);
+
+    for (const QImage &layer : std::as_const(m_layers))
+        painter->drawImage(0, 0, layer);
+}
+
+void RasterWindow::setBackgroundCached(bool cached)
+{
+    m_backgroundCached = cached;
+    invalidateBackground();
+}
+
+// The cached image belongs to whichever thread paints frames; it is only
+// flagged here and rebuilt by the next frame.
+void RasterWindow::invalidateBackground()
+{
+    m_backgroundDirty = true;
+    invalidate();
+}
+
+void RasterWindow::paintBackground(QPainter *painter)
+{
+    const bool dirty = m_backgroundDirty.exchange(false);
+    if (!m_backgroundCached) {
+        m_background = QImage();
+        renderBackground(painter);
+        return;
+    }
+
+    const qreal dpr = painter->device()->devicePixelRatio();
+    if (dirty || m_background.isNull() || m_background.devicePixelRatio() != dpr
+            || m_background.size() != m_targetSize * dpr) {
+        m_background = QImage(m_targetSize * dpr, QImage::Format_ARGB32_Premultiplied);
+        m_background.setDevicePixelRatio(dpr);
+        m_background.fill(Qt::transparent);
+        QPainter backgroundPainter(&m_background);
+        renderBackground(&backgroundPainter);
+    }
+
+    painter->save();
+    painter->setCompositionMode(QPainter::CompositionMode_Source);
+    painter->drawImage(0, 0, m_background);
+    painter->restore();
+}
+
+void RasterWindow::setPresentMode(PresentMode mode)
+{
+    if (m_presentMode == mode)
+        return;
+
+    stopRenderThread();
+    m_presentMode = mode;
+    if (mode != DirectPresent)
+        startRenderThread();
+    renderLater();
+}
+
+void RasterWindow::startRenderThread()
+{
+    const int count = m_presentMode == TripleBuffered ? 3 : 2;
+    m_buffers.resize(count);
+    for (int i = 0; i < count; ++i)
+        m_freeBuffers.append(i);
+
+    m_renderThread.reset(QThread::create([this] { renderFrames(); }));
+    m_renderThread->start();
+}
+
+void RasterWindow::stopRendering()
+{
+    stopRenderThread();
+}
+
+void RasterWindow::stopRenderThread()
+{
+    if (!m_renderThread)
+        return;
+
+    {
+        QMutexLocker locker(&m_bufferMutex);
+        m_stopRendering = true;
+        m_bufferCondition.wakeAll();
+    }
+    m_renderThread->wait();
+    m_renderThread.reset();
+
+    m_stopRendering = false;
+    m_renderRequested = false;
+    m_renderIdle = false;
+    m_buffers.clear();
+    m_freeBuffers.clear();
+    m_readyBuffers.clear();
+}
+
+// Cancels a requested frame and waits for the one being rendered, after
+// which the GUI thread may touch rendering state again.
+void RasterWindow::waitForRenderThread()
+{
+    QMutexLocker locker(&m_bufferMutex);
+    m_renderRequested = false;
+    while (m_rendering)
+        m_bufferCondition.wait(&m_bufferMutex);
+}
+
+// GUI thread: shows the newest rendered frame and, if 'renderNext', asks
+// the render thread for the one after it.
+void RasterWindow::presentFrame(bool renderNext)
+{
+    if (!isExposed() || m_suspended)
+        return;
+
+    const qint64 frameStart = m_clock.nsecsElapsed();
+
+    int index = -1;
+    QRegion damage;
+    bool idle;
+    {
+        QMutexLocker locker(&m_bufferMutex);
+        // Only the newest frame is shown. Older ones are dropped, but what
+        // they changed still has to reach the window.
+        while (!m_readyBuffers.isEmpty()) {
+            if (index >= 0)
+                m_freeBuffers.append(index);
+            index = m_readyBuffers.takeFirst();
+            damage += m_buffers.at(index).damage;
+        }
+        if (renderNext) {
+            if (index < 0 && m_rendering && m_animating)
+                ++m_presentStarvations;
+            m_renderRequested = true;
+            m_requestedSize = size();
+            m_requestedDevicePixelRatio = devicePixelRatio();
+        }
+        idle = m_renderIdle;
+        m_bufferCondition.wakeAll();
+    }
+
+    if (index >= 0) {
+        const FrameBuffer &buffer = m_buffers.at(index);
+        damage &= QRect(0, 0, width(), height());
+        if (!damage.isEmpty()) {
+            m_backingStore->beginPaint(damage);
+            QPainter painter(m_backingStore->paintDevice());
+            painter.setClipRegion(damage);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.drawImage(0, 0, buffer.image);
+            painter.end();
+            m_backingStore->endPaint();
+            m_backingStore->flush(damage);
+        }
+
+        recordFrame(frameStart, frameStart + buffer.renderTime);
+
+        QMutexLocker locker(&m_bufferMutex);
+        m_freeBuffers.append(index);
+        m_bufferCondition.wakeAll();
+    }
+
+    if (renderNext)
+        scheduleNextFrame(frameStart, index < 0 && idle);
+}
+
+// Render thread: renders one frame per request into a free buffer. A buffer
+// is only repainted where it differs from the current frame, which covers
+// the changes of the frames rendered into the other buffers meanwhile.
+void RasterWindow::renderFrames()
+{
+    QMutexLocker locker(&m_bufferMutex);
+    for (;;) {
+        bool starved = false;
+        while (!m_stopRendering && (!m_renderRequested || m_freeBuffers.isEmpty())) {
+            if (m_renderRequested && !starved) {
+                starved = true;
+                ++m_bufferStarvations;
+            }
+            m_bufferCondition.wait(&m_bufferMutex);
+        }
+        if (m_stopRendering)
+            return;
+
+        const int index = m_freeBuffers.takeFirst();
+        m_renderRequested = false;
+        m_rendering = true;
+        m_targetSize = m_requestedSize;
+        m_targetDevicePixelRatio = m_requestedDevicePixelRatio;
+        locker.unlock();
+
+        QElapsedTimer timer;
+        timer.start();
+        FrameBuffer &buffer = m_buffers[index];
+        const QRegion region = nextDamage();
+        if (!region.isEmpty()) {
+            const qreal dpr = m_targetDevicePixelRatio;
+            const QSize pixelSize = m_targetSize * dpr;
+            if (buffer.image.size() != pixelSize || buffer.image.devicePixelRatio() != dpr) {
+                buffer.image = QImage(pixelSize, QImage::Format_ARGB32_Premultiplied);
+                buffer.image.setDevicePixelRatio(dpr);
+                buffer.stale = QRect(QPoint(), m_targetSize);
+            }
+            for (FrameBuffer &other : m_buffers) {
+                if (&other != &buffer)
+                    other.stale += region;
+            }
+
+            QPainter painter(&buffer.image);
+            paintFrame(&painter, buffer.stale + region);
+            painter.end();
+            buffer.stale = QRegion();
+            buffer.damage = region;
+            buffer.renderTime = timer.nsecsElapsed();
+        }
+
+        locker.relock();
+        m_rendering = false;
+        m_renderIdle = region.isEmpty();
+        if (m_renderIdle)
+            m_freeBuffers.append(index);
+        else
+            m_readyBuffers.append(index);
+        m_bufferCondition.wakeAll();
+
+        // An animating window presents it on its next scheduled frame.
+        if (!m_renderIdle && !m_animating)
+            QMetaObject::invokeMethod(this, [this] { presentFrame(false); }, Qt::QueuedConnection);
+    }
+}
+
 //! [4]
 void RasterWindow::render(QPainter *painter)
 {
-    painter->drawText(QRectF(0, 0, width(), height()), Qt::AlignCenter, QStringLiteral("QWindow"));
+    painter->drawText(QRectF(QPointF(), targetSize()), Qt::AlignCenter, QStringLiteral("QWindow"));
 }
 //! [4]
+
+void RasterWindow::renderBackground(QPainter *painter)
+{
+    painter->fillRect(QRect(QPoint(), targetSize()), QGradient::NightFade);
+}
@@ -54,13 +54,98 @@
 //! [1]
 #include <QtGui>
 
+#include <atomic>
+
+#include "scenelayer.h"
+
 class RasterWindow : public QWindow
 {
     Q_OBJECT
 public:
     explicit RasterWindow(QWindow *parent = nullptr);
+    ~RasterWindow();
 
     virtual void render(QPainter *painter);
+    // Static content drawn under render(). With background caching enabled
+    // it is rendered once into an image and only redrawn after a resize, a
+    // device pixel ratio change, a theme change or invalidateBackground().
+    virtual void renderBackground(QPainter *painter);
+
+    void setBackgroundCached(bool cached);
+    bool isBackgroundCached() const { return m_backgroundCached; }
+
+    // Independent layers drawn in order on top of the background. With
+    // parallel rendering enabled, renderNow() rasterizes each layer into its
+    // own premultiplied image on the global thread pool and composites them
+    // instead of calling render(); renderLayer() must then be thread safe.
+    virtual int layerCount() const;
+    virtual void renderLayer(int layer, QPainter *painter);
+
+    void setParallelRendering(bool parallel);
+    bool isParallelRendering() const { return m_parallelRendering; }
+
+    // Root of the retained scene, drawn on top of render() and the layers
+    // above. Changes to its layers add their own damage, so a window whose
+    // content lives entirely in the scene can return an empty region from
+    // damagedRegion().
+    SceneLayer *scene() const { return m_scene.data(); }
+
+    // How frames reach the screen. DirectPresent paints into the backing
+    // store and flushes it on the GUI thread. The buffered modes render on a
+    // dedicated thread into two or three frame buffers, and the GUI thread
+    // only copies the newest finished one to the backing store and flushes
+    // it, so the next frame can render while a flush is in progress. What
+    // that gains depends on how long the platform's flush blocks; compare
+    // the modes with favClock's --present and --stats options before
+    // picking one. In these modes damagedRegion(), the render
+    // functions and changes to the scene run on the render thread, one frame
+    // at a time, and see the window size and device pixel ratio as they were
+    // when the frame was requested.
+    enum PresentMode { DirectPresent, DoubleBuffered, TripleBuffered };
+    void setPresentMode(PresentMode mode);
+    PresentMode presentMode() const { return m_presentMode; }
+
+    // Continuous animation driven by requestUpdate(), so frames follow the
+    // display's vsync where the platform supports it. A target frame rate of
+    // 0 means the screen refresh rate; frames without damage drop to the idle
+    // frame rate.
+    void setAnimating(bool animating);
+    bool isAnimating() const { return m_animating; }
+    void setTargetFrameRate(qreal fps);
+    qreal targetFrameRate() const { return m_targetFrameRate; }
+    void setIdleFrameRate(qreal fps);
+    qreal idleFrameRate() const { return m_idleFrameRate; }
+
+    // A window that is not exposed, minimized or hidden (which includes
+    // being fully occluded or on another virtual desktop, where the
+    // platform reports it) renders nothing and keeps no timer running until
+    // it comes back; animations then resume at the current time.
+    bool isSuspended() const { return m_suspended; }
+
+    // Times in milliseconds over the most recent animated frames. A frame is
+    // missed when it arrives more than half an interval late. With buffered
+    // presentation, a buffer starvation is the render thread waiting for a
+    // free buffer, and a present starvation a vsync without a new frame.
+    // Wakeups are timer and update request events handled in the last few
+    // seconds; a suspended window has none.
+    struct FrameStatistics
+    {
+        int frameCount = 0;
+        int missedFrames = 0;
+        int bufferStarvations = 0;
+        int presentStarvations = 0;
+        qreal meanFrameTime = 0;
+        qreal p99FrameTime = 0;
+        qreal meanRenderTime = 0;
+        qreal wakeupsPerSecond = 0;
+    };
+    FrameStatistics frameStatistics() const;
+    void resetFrameStatistics();
+
+    // Renders the next frame into 'device' instead of the backing store, as
+    // renderNow() would, and returns the region that was repainted. The
+    // device is expected to be the size of the window; it need not be shown.
+    QRegion renderTo(QPaintDevice *device);
 
 public slots:
     void renderLater();
@@ -72,8 +157,92 @@ protected:
     void resizeEvent(QResizeEvent *event) override;
     void exposeEvent(QExposeEvent *event) override;
 
+    // Called once per frame before render(). Only the returned region is
+    // repainted and flushed; the default is the whole window.
+    virtual QRegion damagedRegion();
+    // Makes the next frame repaint the whole window.
+    void invalidate();
+    void invalidateBackground();
+
+    // Size and device pixel ratio of the surface the current frame is
+    // rendered to, valid from damagedRegion() on. Frame code uses these
+    // rather than size(), which the GUI thread may change meanwhile.
+    QSize targetSize() const { return m_targetSize; }
+    qreal targetDevicePixelRatio() const { return m_targetDevicePixelRatio; }
+
+    // Joins the render thread. A subclass whose frame functions use its own
+    // state calls this from its destructor, before that state goes away;
+    // the next frame starts the thread again.
+    void stopRendering();
+
 private:
+    friend class SceneLayer;
+
+    struct FrameBuffer
+    {
+        QImage image;
+        QRegion stale;  // changed since this buffer was last painted
+        QRegion damage; // changed relative to the frame before it
+        qint64 renderTime = 0;
+    };
+
+    void updateSuspended();
+    void recordWakeup();
+    QRegion nextDamage();
+    void presentFrame(bool renderNext);
+    void renderFrames();
+    void startRenderThread();
+    void stopRenderThread();
+    void waitForRenderThread();
+    void paintFrame(QPainter *painter, const QRegion &region);
+    void paintBackground(QPainter *painter);
+    void paintLayers(QPainter *painter, const QRegion &region);
+    qreal refreshRate() const;
+    qint64 frameInterval(bool idle) const;
+    void recordFrame(qint64 start, qint64 end);
+    void scheduleNextFrame(qint64 frameStart, bool idle);
+
     QBackingStore *m_backingStore;
+    std::atomic<bool> m_fullRepaint{true};
+    QSize m_targetSize;
+    qreal m_targetDevicePixelRatio = 1;
+    QSize m_lastDeviceSize;
+    std::atomic<bool> m_backgroundCached{false};
+    std::atomic<bool> m_backgroundDirty{true};
+    QImage m_background;
+    std::atomic<bool> m_parallelRendering{false};
+    QList<QImage> m_layers;
+    QScopedPointer<SceneLayer> m_scene;
+    std::atomic<bool> m_updatingFrame{false};
+
+    PresentMode m_presentMode = DirectPresent;
+    QScopedPointer<QThread> m_renderThread;
+    mutable QMutex m_bufferMutex;
+    QWaitCondition m_bufferCondition;
+    QList<FrameBuffer> m_buffers;
+    QList<int> m_freeBuffers;
+    QList<int> m_readyBuffers;
+    QSize m_requestedSize;
+    qreal m_requestedDevicePixelRatio = 1;
+    bool m_renderRequested = false;
+    bool m_rendering = false;
+    bool m_renderIdle = false;
+    bool m_stopRendering = false;
+    int m_bufferStarvations = 0;
+    int m_presentStarvations = 0;
+
+    std::atomic<bool> m_animating{false};
+    qreal m_targetFrameRate = 0;
+    qreal m_idleFrameRate = 4;
+    QTimer m_frameTimer;
+    QElapsedTimer m_clock;
+    qint64 m_lastFrameStart = -1;
+    int m_frameCount = 0;
+    int m_missedFrames = 0;
+    QList<qint64> m_frameTimes;
+    QList<qint64> m_renderTimes;
+    bool m_suspended = true;
+    QList<qint64> m_wakeups;
 };
 //! [1]
 #endif // RASTERWINDOW_H
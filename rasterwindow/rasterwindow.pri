@@ -1,3 +1,3 @@
 INCLUDEPATH += $$PWD
-SOURCES += $$PWD/rasterwindow.cpp
-HEADERS += $$PWD/rasterwindow.h
+SOURCES += $$PWD/rasterwindow.cpp $$PWD/scenelayer.cpp $$PWD/spriteblitter.cpp
+HEADERS += $$PWD/rasterwindow.h $$PWD/scenelayer.h $$PWD/spriteblitter.h
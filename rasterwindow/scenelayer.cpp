@@ -0,0 +1,222 @@
+// scenelayer.cpp
+
+#include "scenelayer.h"
+#include "rasterwindow.h"
+
+#include <cmath>
+
+// Larger path caches are not worth their memory; such layers draw directly.
+static const int kMaxCacheSide = 4096;
+
+SceneLayer::SceneLayer(RasterWindow *window, SceneLayer *parent)
+    : m_window(window)
+    , m_parent(parent)
+{
+}
+
+SceneLayer::~SceneLayer()
+{
+    qDeleteAll(m_children);
+}
+
+SceneLayer *SceneLayer::addLayer()
+{
+    SceneLayer *layer = new SceneLayer(m_window, this);
+    m_children.append(layer);
+    scheduleFrame();
+    return layer;
+}
+
+void SceneLayer::removeLayer(SceneLayer *layer)
+{
+    if (!m_children.removeOne(layer))
+        return;
+
+    // Whatever it drew last is uncovered in the next frame.
+    m_removedRegion += layer->paintedRegion();
+    delete layer;
+    scheduleFrame();
+}
+
+void SceneLayer::setImage(const QImage &image, const QPointF &offset)
+{
+    m_content = image.isNull() ? NoContent : ImageContent;
+    m_image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    m_offset = offset;
+    m_path = QPainterPath();
+    m_cache = QImage();
+    m_cacheScale = 0;
+    markDirty();
+}
+
+void SceneLayer::setPath(const QPainterPath &path, const QPen &pen, const QBrush &brush)
+{
+    m_content = path.isEmpty() ? NoContent : PathContent;
+    m_image = QImage();
+    m_path = path;
+    m_pen = pen;
+    m_brush = brush;
+    m_cache = QImage();
+    m_cacheScale = 0;
+    markDirty();
+}
+
+void SceneLayer::clearContent()
+{
+    setImage(QImage());
+}
+
+void SceneLayer::setTransform(const QTransform &transform)
+{
+    if (m_transform == transform)
+        return;
+    m_transform = transform;
+    markDirty();
+}
+
+void SceneLayer::setOpacity(qreal opacity)
+{
+    opacity = qBound<qreal>(0, opacity, 1);
+    if (m_opacity == opacity)
+        return;
+    m_opacity = opacity;
+    markDirty();
+}
+
+void SceneLayer::setVisible(bool visible)
+{
+    if (m_visible == visible)
+        return;
+    m_visible = visible;
+    markDirty();
+}
+
+QRectF SceneLayer::boundingRect() const
+{
+    switch (m_content) {
+    case ImageContent:
+        return QRectF(m_offset, QSizeF(m_image.size()) / m_image.devicePixelRatio());
+    case PathContent: {
+        // Half the pen plus half a pixel of antialiased edge.
+        const qreal pen = m_pen.style() == Qt::NoPen ? 0 : qMax<qreal>(m_pen.widthF(), 1);
+        const qreal margin = pen / 2 + 0.5;
+        return m_path.controlPointRect().adjusted(-margin, -margin, margin, margin);
+    }
+    case NoContent:
+        break;
+    }
+    return QRectF();
+}
+
+void SceneLayer::markDirty()
+{
+    if (m_dirty)
+        return;
+    m_dirty = true;
+    scheduleFrame();
+}
+
+// An animating window picks the change up with its next frame anyway, as
+// does the frame being prepared.
+void SceneLayer::scheduleFrame()
+{
+    if (!m_window->isAnimating() && !m_window->m_updatingFrame)
+        m_window->renderLater();
+}
+
+QRegion SceneLayer::paintedRegion() const
+{
+    QRegion region = m_paintedRect;
+    for (const SceneLayer *child : m_children)
+        region += child->paintedRegion();
+    return region;
+}
+
+void SceneLayer::updateState(bool parentChanged, QRegion *damage)
+{
+    *damage += m_removedRegion;
+    m_removedRegion = QRegion();
+
+    const bool changed = m_dirty || parentChanged;
+    if (changed) {
+        m_sceneTransform = m_parent ? m_transform * m_parent->m_sceneTransform : m_transform;
+        m_sceneOpacity = m_parent ? m_opacity * m_parent->m_sceneOpacity : m_opacity;
+        m_sceneVisible = m_visible && (!m_parent || m_parent->m_sceneVisible);
+
+        // One pixel of slack for antialiasing and smooth image transforms.
+        QRect rect;
+        if (m_sceneVisible && m_sceneOpacity > 0 && m_content != NoContent)
+            rect = m_sceneTransform.mapRect(boundingRect()).toAlignedRect().adjusted(-1, -1, 1, 1);
+        *damage += m_paintedRect;
+        *damage += rect;
+        m_paintedRect = rect;
+        m_dirty = false;
+    }
+
+    for (SceneLayer *child : std::as_const(m_children))
+        child->updateState(changed, damage);
+}
+
+void SceneLayer::paint(QPainter *painter, const QRect &clip)
+{
+    if (!m_sceneVisible)
+        return;
+
+    if (m_sceneOpacity > 0 && m_paintedRect.intersects(clip)) {
+        painter->save();
+        // On top of whatever transform the painter came with.
+        painter->setWorldTransform(m_sceneTransform, true);
+        painter->setOpacity(m_sceneOpacity);
+        if (painter->worldTransform().type() > QTransform::TxTranslate)
+            painter->setRenderHint(QPainter::SmoothPixmapTransform);
+
+        if (m_content == ImageContent) {
+            painter->drawImage(m_offset, m_image);
+        } else if (m_content == PathContent) {
+            // The cache is rendered at the scale the layer ends up at on
+            // the device, so only rotation and translation are resampled.
+            const qreal scale = painter->device()->devicePixelRatio()
+                    * std::sqrt(qAbs(painter->worldTransform().determinant()));
+            rasterize(scale);
+            if (!m_cache.isNull()) {
+                painter->drawImage(boundingRect().topLeft(), m_cache);
+            } else {
+                painter->setRenderHint(QPainter::Antialiasing);
+                painter->setPen(m_pen);
+                painter->setBrush(m_brush);
+                painter->drawPath(m_path);
+            }
+        }
+        painter->restore();
+    }
+
+    for (SceneLayer *child : std::as_const(m_children))
+        child->paint(painter, clip);
+}
+
+void SceneLayer::rasterize(qreal scale)
+{
+    // Rotations perturb the determinant slightly; ignore such noise.
+    if (m_cacheScale > 0 && qAbs(m_cacheScale - scale) <= m_cacheScale * 1e-3)
+        return;
+
+    m_cacheScale = scale;
+    m_cache = QImage();
+
+    const QRectF rect = boundingRect();
+    const QSize pixelSize(qCeil(rect.width() * scale), qCeil(rect.height() * scale));
+    if (scale <= 0 || pixelSize.isEmpty()
+            || pixelSize.width() > kMaxCacheSide || pixelSize.height() > kMaxCacheSide)
+        return;
+
+    m_cache = QImage(pixelSize, QImage::Format_ARGB32_Premultiplied);
+    m_cache.setDevicePixelRatio(scale);
+    m_cache.fill(Qt::transparent);
+
+    QPainter p(&m_cache);
+    p.setRenderHint(QPainter::Antialiasing);
+    p.translate(-rect.topLeft());
+    p.setPen(m_pen);
+    p.setBrush(m_brush);
+    p.drawPath(m_path);
+}
@@ -0,0 +1,89 @@
+// scenelayer.h
+
+#ifndef SCENELAYER_H
+#define SCENELAYER_H
+
+#include <QtGui>
+
+class RasterWindow;
+
+// A node of RasterWindow's retained scene: an image or a filled and stroked
+// path, placed by a transform relative to its parent and drawn with an
+// opacity. Children are drawn after their parent, in the order they were
+// added.
+//
+// Every change marks the layer dirty. Before each frame the window repaints
+// the area a dirty layer covered in the previous frame and the area it covers
+// now, so animating a layer only means updating its transform. Path content
+// is rasterized once per device scale and reused while the layer moves,
+// rotates or fades.
+class SceneLayer
+{
+public:
+    ~SceneLayer();
+
+    // The new layer is owned by this one and drawn above its siblings.
+    SceneLayer *addLayer();
+    void removeLayer(SceneLayer *layer);
+    QList<SceneLayer *> layers() const { return m_children; }
+
+    // 'offset' is where the image's top left corner lies in layer
+    // coordinates; its logical size follows its device pixel ratio.
+    void setImage(const QImage &image, const QPointF &offset = QPointF());
+    void setPath(const QPainterPath &path, const QPen &pen, const QBrush &brush = Qt::NoBrush);
+    void clearContent();
+
+    void setTransform(const QTransform &transform);
+    QTransform transform() const { return m_transform; }
+    void setOpacity(qreal opacity);
+    qreal opacity() const { return m_opacity; }
+    void setVisible(bool visible);
+    bool isVisible() const { return m_visible; }
+
+    bool isDirty() const { return m_dirty; }
+    // The content's extent in layer coordinates, excluding children.
+    QRectF boundingRect() const;
+
+private:
+    friend class RasterWindow;
+
+    enum Content { NoContent, ImageContent, PathContent };
+
+    SceneLayer(RasterWindow *window, SceneLayer *parent);
+
+    void markDirty();
+    void scheduleFrame();
+    QRegion paintedRegion() const;
+    void updateState(bool parentChanged, QRegion *damage);
+    void paint(QPainter *painter, const QRect &clip);
+    void rasterize(qreal scale);
+
+    RasterWindow *m_window;
+    SceneLayer *m_parent;
+    QList<SceneLayer *> m_children;
+
+    Content m_content = NoContent;
+    QImage m_image;
+    QPointF m_offset;
+    QPainterPath m_path;
+    QPen m_pen;
+    QBrush m_brush;
+
+    QTransform m_transform;
+    qreal m_opacity = 1;
+    bool m_visible = true;
+    bool m_dirty = true;
+
+    // State resolved against the parents by updateState().
+    QTransform m_sceneTransform;
+    qreal m_sceneOpacity = 1;
+    bool m_sceneVisible = true;
+    QRect m_paintedRect;
+    QRegion m_removedRegion;
+
+    // Rasterized path content and the device scale it was rendered at.
+    QImage m_cache;
+    qreal m_cacheScale = 0;
+};
+
+#endif // SCENELAYER_H
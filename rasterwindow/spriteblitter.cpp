@@ -0,0 +1,409 @@
+// spriteblitter.cpp
+
+#include "spriteblitter.h"
+
+#include <cmath>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#  define SPRITEBLITTER_X86
+#  include <immintrin.h>
+#endif
+
+namespace {
+
+// One row of target pixels. The sample position (u, v) in sprite pixels is
+// 16.16 fixed point, advancing by (du, dv) per target pixel.
+struct Span
+{
+    quint32 *dst;
+    int count;
+    const quint32 *src;
+    int width;
+    int height;
+    int stride; // in pixels
+    int u, v;
+    int du, dv;
+};
+
+inline bool isInterior(const Span &s, int u, int v)
+{
+    const int x = u >> 16;
+    const int y = v >> 16;
+    return x >= 0 && x < s.width - 1 && y >= 0 && y < s.height - 1;
+}
+
+inline quint32 texel(const Span &s, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= s.width || y >= s.height)
+        return 0;
+    return s.src[qsizetype(y) * s.stride + x];
+}
+
+// The arithmetic every implementation follows: 8 bit weights, vertical then
+// horizontal interpolation with truncation, and source-over with a rounded
+// division by 255.
+inline void blendPixel(quint32 *dst, const Span &s, int u, int v)
+{
+    const int x = u >> 16;
+    const int y = v >> 16;
+    const quint32 tl = texel(s, x, y);
+    const quint32 tr = texel(s, x + 1, y);
+    const quint32 bl = texel(s, x, y + 1);
+    const quint32 br = texel(s, x + 1, y + 1);
+    if ((tl | tr | bl | br) == 0)
+        return;
+
+    const quint32 fx = (u >> 8) & 0xff;
+    const quint32 fy = (v >> 8) & 0xff;
+
+    quint32 source[4];
+    for (int c = 0; c < 4; ++c) {
+        const int shift = 8 * c;
+        const quint32 l = (((tl >> shift) & 0xff) * (256 - fy) + ((bl >> shift) & 0xff) * fy) >> 8;
+        const quint32 r = (((tr >> shift) & 0xff) * (256 - fy) + ((br >> shift) & 0xff) * fy) >> 8;
+        source[c] = (l * (256 - fx) + r * fx) >> 8;
+    }
+
+    const quint32 alpha = source[3];
+    const quint32 d = *dst;
+    quint32 result = 0;
+    for (int c = 0; c < 4; ++c) {
+        quint32 t = ((d >> (8 * c)) & 0xff) * (255 - alpha) + 128;
+        t = (t + (t >> 8)) >> 8;
+        result |= qMin<quint32>(source[c] + t, 255) << (8 * c);
+    }
+    *dst = result;
+}
+
+void blendSpanScalar(const Span &s)
+{
+    int u = s.u, v = s.v;
+    for (int i = 0; i < s.count; ++i, u += s.du, v += s.dv)
+        blendPixel(s.dst + i, s, u, v);
+}
+
+#ifdef SPRITEBLITTER_X86
+
+// Interpolates and blends two pixels held as 16 bit channels. The weights
+// hold each pixel's fraction in all four of its lanes.
+__attribute__((target("sse4.1")))
+inline __m128i blend2Sse41(__m128i tl, __m128i tr, __m128i bl, __m128i br,
+                           __m128i fx, __m128i fy, __m128i dst)
+{
+    const __m128i full = _mm_set1_epi16(256);
+    const __m128i ify = _mm_sub_epi16(full, fy);
+    const __m128i ifx = _mm_sub_epi16(full, fx);
+    const __m128i l = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(tl, ify), _mm_mullo_epi16(bl, fy)), 8);
+    const __m128i r = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(tr, ify), _mm_mullo_epi16(br, fy)), 8);
+    const __m128i src = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(l, ifx), _mm_mullo_epi16(r, fx)), 8);
+
+    __m128i alpha = _mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i t = _mm_mullo_epi16(dst, _mm_sub_epi16(_mm_set1_epi16(255), alpha));
+    t = _mm_add_epi16(t, _mm_set1_epi16(128));
+    t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    return _mm_add_epi16(src, t);
+}
+
+__attribute__((target("sse4.1")))
+void blendSpanSse41(const Span &s)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i steps = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i du = _mm_mullo_epi32(_mm_set1_epi32(s.du), steps);
+    const __m128i dv = _mm_mullo_epi32(_mm_set1_epi32(s.dv), steps);
+    const __m128i stride = _mm_set1_epi32(s.stride);
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    // Spread the weight in the low byte of each 32 bit lane over the four
+    // 16 bit channel lanes of pixels 0 and 1, or 2 and 3.
+    const __m128i spreadLo = _mm_setr_epi8(0, -1, 0, -1, 0, -1, 0, -1, 4, -1, 4, -1, 4, -1, 4, -1);
+    const __m128i spreadHi = _mm_setr_epi8(8, -1, 8, -1, 8, -1, 8, -1, 12, -1, 12, -1, 12, -1, 12, -1);
+
+    int u = s.u, v = s.v;
+    int i = 0;
+    while (i < s.count) {
+        if (i + 4 > s.count || !isInterior(s, u, v)
+                || !isInterior(s, u + 3 * s.du, v + 3 * s.dv)) {
+            blendPixel(s.dst + i, s, u, v);
+            ++i;
+            u += s.du;
+            v += s.dv;
+            continue;
+        }
+
+        const __m128i uu = _mm_add_epi32(_mm_set1_epi32(u), du);
+        const __m128i vv = _mm_add_epi32(_mm_set1_epi32(v), dv);
+        const __m128i offsets = _mm_add_epi32(_mm_mullo_epi32(_mm_srai_epi32(vv, 16), stride),
+                                              _mm_srai_epi32(uu, 16));
+        alignas(16) int o[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(o), offsets);
+        const quint32 *p = s.src;
+        const qsizetype n = s.stride;
+        const __m128i tl = _mm_setr_epi32(p[o[0]], p[o[1]], p[o[2]], p[o[3]]);
+        const __m128i tr = _mm_setr_epi32(p[o[0] + 1], p[o[1] + 1], p[o[2] + 1], p[o[3] + 1]);
+        const __m128i bl = _mm_setr_epi32(p[o[0] + n], p[o[1] + n], p[o[2] + n], p[o[3] + n]);
+        const __m128i br = _mm_setr_epi32(p[o[0] + n + 1], p[o[1] + n + 1], p[o[2] + n + 1], p[o[3] + n + 1]);
+
+        const __m128i fx = _mm_and_si128(_mm_srli_epi32(uu, 8), byteMask);
+        const __m128i fy = _mm_and_si128(_mm_srli_epi32(vv, 8), byteMask);
+        const __m128i dst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.dst + i));
+
+        const __m128i lo = blend2Sse41(_mm_unpacklo_epi8(tl, zero), _mm_unpacklo_epi8(tr, zero),
+                                       _mm_unpacklo_epi8(bl, zero), _mm_unpacklo_epi8(br, zero),
+                                       _mm_shuffle_epi8(fx, spreadLo), _mm_shuffle_epi8(fy, spreadLo),
+                                       _mm_unpacklo_epi8(dst, zero));
+        const __m128i hi = blend2Sse41(_mm_unpackhi_epi8(tl, zero), _mm_unpackhi_epi8(tr, zero),
+                                       _mm_unpackhi_epi8(bl, zero), _mm_unpackhi_epi8(br, zero),
+                                       _mm_shuffle_epi8(fx, spreadHi), _mm_shuffle_epi8(fy, spreadHi),
+                                       _mm_unpackhi_epi8(dst, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(s.dst + i), _mm_packus_epi16(lo, hi));
+
+        i += 4;
+        u += 4 * s.du;
+        v += 4 * s.dv;
+    }
+}
+
+__attribute__((target("avx2")))
+inline __m256i blend2Avx2(__m256i tl, __m256i tr, __m256i bl, __m256i br,
+                          __m256i fx, __m256i fy, __m256i dst)
+{
+    const __m256i full = _mm256_set1_epi16(256);
+    const __m256i ify = _mm256_sub_epi16(full, fy);
+    const __m256i ifx = _mm256_sub_epi16(full, fx);
+    const __m256i l = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(tl, ify), _mm256_mullo_epi16(bl, fy)), 8);
+    const __m256i r = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(tr, ify), _mm256_mullo_epi16(br, fy)), 8);
+    const __m256i src = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(l, ifx), _mm256_mullo_epi16(r, fx)), 8);
+
+    __m256i alpha = _mm256_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    __m256i t = _mm256_mullo_epi16(dst, _mm256_sub_epi16(_mm256_set1_epi16(255), alpha));
+    t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+    t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    return _mm256_add_epi16(src, t);
+}
+
+// Like the SSE4.1 version with eight pixels at a time; unpacking and
+// shuffling work within 128 bit lanes, so pixels 0, 1, 4, 5 go through the
+// low halves and 2, 3, 6, 7 through the high ones, and packing restores the
+// order.
+__attribute__((target("avx2")))
+void blendSpanAvx2(const Span &s)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i steps = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i du = _mm256_mullo_epi32(_mm256_set1_epi32(s.du), steps);
+    const __m256i dv = _mm256_mullo_epi32(_mm256_set1_epi32(s.dv), steps);
+    const __m256i stride = _mm256_set1_epi32(s.stride);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    const __m256i spreadLo = _mm256_setr_epi8(0, -1, 0, -1, 0, -1, 0, -1, 4, -1, 4, -1, 4, -1, 4, -1,
+                                              0, -1, 0, -1, 0, -1, 0, -1, 4, -1, 4, -1, 4, -1, 4, -1);
+    const __m256i spreadHi = _mm256_setr_epi8(8, -1, 8, -1, 8, -1, 8, -1, 12, -1, 12, -1, 12, -1, 12, -1,
+                                              8, -1, 8, -1, 8, -1, 8, -1, 12, -1, 12, -1, 12, -1, 12, -1);
+    const int *src = reinterpret_cast<const int *>(s.src);
+
+    int u = s.u, v = s.v;
+    int i = 0;
+    while (i < s.count) {
+        if (i + 8 > s.count || !isInterior(s, u, v)
+                || !isInterior(s, u + 7 * s.du, v + 7 * s.dv)) {
+            blendPixel(s.dst + i, s, u, v);
+            ++i;
+            u += s.du;
+            v += s.dv;
+            continue;
+        }
+
+        const __m256i uu = _mm256_add_epi32(_mm256_set1_epi32(u), du);
+        const __m256i vv = _mm256_add_epi32(_mm256_set1_epi32(v), dv);
+        const __m256i top = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(vv, 16), stride),
+                                             _mm256_srai_epi32(uu, 16));
+        const __m256i bottom = _mm256_add_epi32(top, stride);
+        const __m256i tl = _mm256_i32gather_epi32(src, top, 4);
+        const __m256i tr = _mm256_i32gather_epi32(src, _mm256_add_epi32(top, one), 4);
+        const __m256i bl = _mm256_i32gather_epi32(src, bottom, 4);
+        const __m256i br = _mm256_i32gather_epi32(src, _mm256_add_epi32(bottom, one), 4);
+
+        const __m256i fx = _mm256_and_si256(_mm256_srli_epi32(uu, 8), byteMask);
+        const __m256i fy = _mm256_and_si256(_mm256_srli_epi32(vv, 8), byteMask);
+        const __m256i dst = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s.dst + i));
+
+        const __m256i lo = blend2Avx2(_mm256_unpacklo_epi8(tl, zero), _mm256_unpacklo_epi8(tr, zero),
+                                      _mm256_unpacklo_epi8(bl, zero), _mm256_unpacklo_epi8(br, zero),
+                                      _mm256_shuffle_epi8(fx, spreadLo), _mm256_shuffle_epi8(fy, spreadLo),
+                                      _mm256_unpacklo_epi8(dst, zero));
+        const __m256i hi = blend2Avx2(_mm256_unpackhi_epi8(tl, zero), _mm256_unpackhi_epi8(tr, zero),
+                                      _mm256_unpackhi_epi8(bl, zero), _mm256_unpackhi_epi8(br, zero),
+                                      _mm256_shuffle_epi8(fx, spreadHi), _mm256_shuffle_epi8(fy, spreadHi),
+                                      _mm256_unpackhi_epi8(dst, zero));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(s.dst + i), _mm256_packus_epi16(lo, hi));
+
+        i += 8;
+        u += 8 * s.du;
+        v += 8 * s.dv;
+    }
+}
+
+#endif // SPRITEBLITTER_X86
+
+// Narrows [*lo, *hi) to the indices i where a + b * i lies in (min, max).
+void clampRange(qreal a, qreal b, qreal min, qreal max, qreal *lo, qreal *hi)
+{
+    if (qFuzzyIsNull(b)) {
+        if (a <= min || a >= max)
+            *hi = *lo;
+        return;
+    }
+    qreal first = (min - a) / b;
+    qreal last = (max - a) / b;
+    if (b < 0)
+        std::swap(first, last);
+    *lo = qMax(*lo, first);
+    *hi = qMin(*hi, last);
+}
+
+} // namespace
+
+// Source-over onto an opaque pixel leaves it opaque, so an RGB32 target
+// takes the same arithmetic and its alpha byte stays 0xff.
+bool SpriteBlitter::isTargetFormat(QImage::Format format)
+{
+    return format == QImage::Format_ARGB32_Premultiplied || format == QImage::Format_RGB32;
+}
+
+bool SpriteBlitter::isSupported(Implementation implementation)
+{
+    switch (implementation) {
+    case Scalar:
+        return true;
+#ifdef SPRITEBLITTER_X86
+    case Sse41:
+        return __builtin_cpu_supports("sse4.1");
+    case Avx2:
+        return __builtin_cpu_supports("avx2");
+#else
+    case Sse41:
+    case Avx2:
+        break;
+#endif
+    }
+    return false;
+}
+
+SpriteBlitter::Implementation SpriteBlitter::bestImplementation()
+{
+    static const Implementation best = isSupported(Avx2) ? Avx2 : isSupported(Sse41) ? Sse41 : Scalar;
+    return best;
+}
+
+const char *SpriteBlitter::name(Implementation implementation)
+{
+    switch (implementation) {
+    case Scalar:
+        return "scalar";
+    case Sse41:
+        return "sse4.1";
+    case Avx2:
+        return "avx2";
+    }
+    return "";
+}
+
+bool SpriteBlitter::blit(QImage *target, const QRect &clip, const QImage &sprite,
+                         const QTransform &transform, Implementation implementation)
+{
+    if (!isTargetFormat(target->format())
+            || sprite.format() != QImage::Format_ARGB32_Premultiplied
+            || !transform.isAffine() || !isSupported(implementation))
+        return false;
+    bool invertible;
+    const QTransform inverse = transform.inverted(&invertible);
+    if (!invertible)
+        return false;
+
+    // Samples within a pixel of the sprite still pick up its edge.
+    const QRectF extent(-1, -1, sprite.width() + 2, sprite.height() + 2);
+    const QRect bounds = transform.mapRect(extent).toAlignedRect() & clip & target->rect();
+    if (bounds.isEmpty() || sprite.isNull())
+        return true;
+
+    void (*blendSpan)(const Span &) = blendSpanScalar;
+#ifdef SPRITEBLITTER_X86
+    if (implementation == Avx2)
+        blendSpan = blendSpanAvx2;
+    else if (implementation == Sse41)
+        blendSpan = blendSpanSse41;
+#endif
+
+    Span span;
+    span.src = reinterpret_cast<const quint32 *>(sprite.constBits());
+    span.width = sprite.width();
+    span.height = sprite.height();
+    span.stride = int(sprite.bytesPerLine() / 4);
+
+    // Sampling positions are pixel centers on both sides.
+    const qreal du = inverse.m11();
+    const qreal dv = inverse.m12();
+    span.du = qRound(du * 65536);
+    span.dv = qRound(dv * 65536);
+
+    for (int y = bounds.top(); y <= bounds.bottom(); ++y) {
+        const QPointF start = inverse.map(QPointF(bounds.left() + 0.5, y + 0.5)) - QPointF(0.5, 0.5);
+        qreal lo = 0;
+        qreal hi = bounds.width();
+        clampRange(start.x(), du, -1, span.width, &lo, &hi);
+        clampRange(start.y(), dv, -1, span.height, &lo, &hi);
+        if (hi <= lo)
+            continue;
+
+        const int first = qMax(0, int(std::floor(lo)));
+        const int last = qMin(bounds.width(), int(std::ceil(hi)));
+        if (last <= first)
+            continue;
+
+        span.dst = reinterpret_cast<quint32 *>(target->scanLine(y)) + bounds.left() + first;
+        span.count = last - first;
+        span.u = qRound((start.x() + first * du) * 65536);
+        span.v = qRound((start.y() + first * dv) * 65536);
+        blendSpan(span);
+    }
+    return true;
+}
+
+bool SpriteBlitter::blit(QPainter *painter, const QImage &sprite, const QTransform &transform)
+{
+    QPaintDevice *device = painter->device();
+    if (!device || device->devType() != QInternal::Image
+            || painter->paintEngine()->type() != QPaintEngine::Raster
+            || painter->compositionMode() != QPainter::CompositionMode_SourceOver
+            || painter->opacity() != 1
+            || painter->worldTransform().type() > QTransform::TxTranslate)
+        return false;
+
+    QImage *target = static_cast<QImage *>(device);
+    if (!isTargetFormat(target->format()))
+        return false;
+
+    const qreal dpr = target->devicePixelRatio();
+    const QTransform toDevice = transform * painter->worldTransform() * QTransform::fromScale(dpr, dpr);
+
+    if (!painter->hasClipping())
+        return blit(target, target->rect(), sprite, toDevice);
+
+    // The clip comes back in logical coordinates. Rectangles that overlap
+    // once scaled to device pixels are merged, so no pixel is blended twice.
+    const QTransform clipToDevice = painter->worldTransform() * QTransform::fromScale(dpr, dpr);
+    const QRect spriteBounds = toDevice.mapRect(QRectF(sprite.rect())).toAlignedRect().adjusted(-1, -1, 1, 1);
+    QRegion clip;
+    for (const QRect &rect : painter->clipRegion()) {
+        const QRect deviceRect = clipToDevice.mapRect(QRectF(rect)).toAlignedRect() & spriteBounds;
+        if (!deviceRect.isEmpty())
+            clip += deviceRect;
+    }
+    for (const QRect &rect : clip) {
+        if (!blit(target, rect, sprite, toDevice))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+// spriteblitter.h
+
+#ifndef SPRITEBLITTER_H
+#define SPRITEBLITTER_H
+
+#include <QtGui>
+
+// Composites a sprite under an arbitrary affine transform straight into a
+// premultiplied QImage: bilinear sampling with transparent edges, then
+// premultiplied source-over. It does what QPainter::drawImage() with
+// SmoothPixmapTransform does for this one case, without the generic
+// pipeline, and has SSE4.1 and AVX2 versions picked at runtime on x86
+// builds with GCC or Clang. Every implementation produces the same pixels.
+class SpriteBlitter
+{
+public:
+    enum Implementation { Scalar, Sse41, Avx2 };
+
+    static Implementation bestImplementation();
+    static bool isSupported(Implementation implementation);
+    static const char *name(Implementation implementation);
+
+    // Premultiplied ARGB32 or RGB32, the format most backing stores use.
+    static bool isTargetFormat(QImage::Format format);
+
+    // Draws 'sprite' onto 'target', with 'transform' mapping sprite pixel
+    // coordinates to target pixels. Only pixels inside 'clip' (in target
+    // pixels) change. The sprite must be Format_ARGB32_Premultiplied, the
+    // target in a target format and the transform affine and invertible;
+    // otherwise nothing is drawn and false is returned.
+    static bool blit(QImage *target, const QRect &clip, const QImage &sprite,
+                     const QTransform &transform, Implementation implementation = bestImplementation());
+
+    // Same, into the image 'painter' paints on, honoring its clip. Only
+    // possible for a raster painter on an image in a target format, with a
+    // translation-only world transform, full opacity and source-over;
+    // 'transform' maps sprite pixels to the painter's logical coordinates.
+    static bool blit(QPainter *painter, const QImage &sprite, const QTransform &transform);
+};
+
+#endif // SPRITEBLITTER_H